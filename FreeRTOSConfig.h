@@ -31,7 +31,7 @@
 #define configCHECK_FOR_STACK_OVERFLOW	1
 #define configUSE_RECURSIVE_MUTEXES     0
 #define configQUEUE_REGISTRY_SIZE       0
-#define configUSE_COUNTING_SEMAPHORES   0
+#define configUSE_COUNTING_SEMAPHORES   1
 #define configUSE_POSIX_ERRNO           0
 
 #define configMAX_PRIORITIES            (4)
@@ -39,7 +39,7 @@
 #define configSUPPORT_DYNAMIC_ALLOCATION 1
 #define configUSE_MALLOC_FAILED_HOOK     1
 
-#define configNUM_THREAD_LOCAL_STORAGE_POINTERS 1
+#define configNUM_THREAD_LOCAL_STORAGE_POINTERS 2
 
 /* Set the following definitions to 1 to include the API function, or zero to
  * exclude the API function. */
@@ -54,6 +54,7 @@
 #define INCLUDE_vTaskDelay                      1
 #define INCLUDE_uxTaskGetStackHighWaterMark     1
 #define INCLUDE_xTaskGetSchedulerState          1
+#define INCLUDE_xTaskGetIdleTaskHandle          1
 
 /* m68k port specific definitions and options. */
 #define portCRITICAL_NESTING_IN_TCB             1
@@ -30,7 +30,7 @@ void BitmapInit(Bitmap_t *bm, uint16_t width, uint16_t height, uint16_t depth,
   uint16_t bytesPerRow = ((width + 15) & ~15) / 8;
   int bplSize = muls16(bytesPerRow, height);
   long size = muls16(bplSize, depth);
-  void *planes = MemAlloc(size, MF_CHIP | MF_ZERO);
+  void *planes = MemAlloc(size, MF_CHIP | MF_ZERO | MF_TAG(MT_DISPLAY));
 
   bm->width = width;
   bm->height = height;
@@ -0,0 +1,12 @@
+#include <blitter.h>
+#include <mutex.h>
+
+static Mutex_t BlitterLock;
+
+void OwnBlitter(void) {
+  MutexLock(&BlitterLock);
+}
+
+void DisownBlitter(void) {
+  MutexUnlock(&BlitterLock);
+}
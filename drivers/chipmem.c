@@ -0,0 +1,202 @@
+#include <FreeRTOS/FreeRTOS.h>
+#include <FreeRTOS/task.h>
+
+#include <sys/errno.h>
+#include <sys/queue.h>
+#include <string.h>
+#include <strings.h>
+#include <atomic.h>
+#include <blitter.h>
+#include <chipmem.h>
+#include <mempool.h>
+
+#define DEBUG 0
+#include <debug.h>
+
+#define ALIGNMENT 16
+
+/* Blitter moves whole words. Single blit transfers at most 1024 rows of 64
+ * words each. Blocks smaller than BLT_MINSZ are moved by the CPU. */
+#define BLT_ROWSZ 128
+#define BLT_MAXROWS 1024U
+#define BLT_MINSZ 256
+
+struct ChipMem {
+  TAILQ_ENTRY(ChipMem) link; /* blocks sorted by address */
+  void *ptr;                 /* current address of the block */
+  size_t size;               /* size of the block (rounded up) */
+  uint32_t locks;            /* the block cannot be moved if non-zero */
+};
+
+typedef TAILQ_HEAD(, ChipMem) ChipMemList_t;
+
+static struct {
+  void *start;          /* first address of the zone */
+  void *end;            /* first address after the zone */
+  size_t free;          /* number of free bytes */
+  ChipMemList_t blocks; /* allocated blocks sorted by address */
+} Zone = {.blocks = TAILQ_HEAD_INITIALIZER(Zone.blocks)};
+
+MEMPOOL_DEFINE(HandlePool, sizeof(ChipMem_t), 16, MF_TAG(MT_DISPLAY));
+
+int ChipMemInit(size_t size) {
+  size = roundup(size, ALIGNMENT);
+  if (!(Zone.start = MemAlloc(size, MF_CHIP | MF_TAG(MT_DISPLAY))))
+    return ENOMEM;
+  Zone.end = Zone.start + size;
+  Zone.free = size;
+  return 0;
+}
+
+/* Moves `size` bytes from `src` to lower address `dst`. Ascending blit reads
+ * source ahead of writing destination, so overlapping ranges are fine. The
+ * caller must own the blitter. */
+static void BltMove(void *dst, const void *src, size_t size) {
+  custom.bltcon0 = (SRCA | DEST) | A_TO_D;
+  custom.bltcon1 = 0;
+  custom.bltafwm = -1;
+  custom.bltalwm = -1;
+  custom.bltamod = 0;
+  custom.bltdmod = 0;
+
+  while (size > 0) {
+    size_t rows = min(size / BLT_ROWSZ, BLT_MAXROWS);
+    size_t words = BLT_ROWSZ / sizeof(uint16_t);
+    if (rows == 0) {
+      rows = 1;
+      words = size / sizeof(uint16_t);
+    }
+    custom.bltapt = (void *)src;
+    custom.bltdpt = dst;
+    /* Zero in either field of BLTSIZE means the maximum value. */
+    custom.bltsize = ((rows & (BLT_MAXROWS - 1)) << 6) | (words & 63);
+    WaitBlitter();
+
+    size_t done = rows * words * sizeof(uint16_t);
+    src += done;
+    dst += done;
+    size -= done;
+  }
+}
+
+static void Move(ChipMem_t *cm, void *dst) {
+  DLOG("ChipMem: move %p (%u bytes) from %p to %p\n", cm, cm->size, cm->ptr,
+       dst);
+  if (cm->size >= BLT_MINSZ)
+    BltMove(dst, cm->ptr, cm->size);
+  else
+    memmove(dst, cm->ptr, cm->size);
+  cm->ptr = dst;
+}
+
+/* Slides unlocked blocks towards the beginning of the zone. Locked blocks
+ * stay where they are and unlocked blocks are moved past them. The blitter
+ * must be owned, as it's used to move large blocks. */
+static void Compact(void) {
+  void *dst = Zone.start;
+  ChipMem_t *cm;
+
+  /* A block could have been unlocked while a blit still accesses it. */
+  WaitBlitter();
+
+  TAILQ_FOREACH (cm, &Zone.blocks, link) {
+    if (cm->locks == 0 && cm->ptr != dst)
+      Move(cm, dst);
+    dst = cm->ptr + cm->size;
+  }
+}
+
+/* Returns the first free range of at least `size` bytes and the block that
+ * precedes it in `prevp` (or NULL if the range starts the zone). */
+static void *FindFree(size_t size, ChipMem_t **prevp) {
+  void *start = Zone.start;
+  ChipMem_t *cm, *prev = NULL;
+
+  TAILQ_FOREACH (cm, &Zone.blocks, link) {
+    if ((size_t)(cm->ptr - start) >= size)
+      break;
+    start = cm->ptr + cm->size;
+    prev = cm;
+  }
+
+  if ((size_t)(Zone.end - start) < size)
+    return NULL;
+
+  *prevp = prev;
+  return start;
+}
+
+ChipMem_t *ChipMemAlloc(size_t size, MemFlags_t flags) {
+  ChipMem_t *cm, *prev;
+  void *ptr;
+
+  size = roundup(size, ALIGNMENT);
+
+  if (!(cm = MemPoolAlloc(HandlePool)))
+    return NULL;
+
+  /* Compaction programs the blitter, so other tasks must not be in the middle
+   * of doing so. The lock cannot be taken with the scheduler suspended. */
+  OwnBlitter();
+  vTaskSuspendAll();
+
+  if (!(ptr = FindFree(size, &prev)) && size <= Zone.free) {
+    Compact();
+    ptr = FindFree(size, &prev);
+  }
+
+  if (ptr) {
+    cm->ptr = ptr;
+    cm->size = size;
+    cm->locks = 0;
+    if (prev)
+      TAILQ_INSERT_AFTER(&Zone.blocks, prev, cm, link);
+    else
+      TAILQ_INSERT_HEAD(&Zone.blocks, cm, link);
+    Zone.free -= size;
+    /* Block can be moved as soon as we resume the scheduler. */
+    if (flags & MF_ZERO)
+      bzero(ptr, size);
+  }
+
+  xTaskResumeAll();
+  DisownBlitter();
+
+  if (!ptr) {
+    MemPoolFree(HandlePool, cm);
+    return NULL;
+  }
+
+  DLOG("ChipMemAlloc(%u) = %p at %p\n", size, cm, ptr);
+  return cm;
+}
+
+void ChipMemFree(ChipMem_t *cm) {
+  if (cm == NULL)
+    return;
+
+  Assert(cm->locks == 0);
+
+  vTaskSuspendAll();
+  TAILQ_REMOVE(&Zone.blocks, cm, link);
+  Zone.free += cm->size;
+  xTaskResumeAll();
+
+  MemPoolFree(HandlePool, cm);
+}
+
+void *ChipMemLock(ChipMem_t *cm) {
+  /* Once lock count is increased the block will not be moved, so it's safe
+   * to read the address afterwards. */
+  AtomicInc(&cm->locks);
+  return cm->ptr;
+}
+
+void ChipMemUnlock(ChipMem_t *cm) {
+  configASSERT(cm->locks > 0);
+  AtomicDec(&cm->locks);
+}
+
+size_t ChipMemAvail(void) {
+  return Zone.free;
+}
@@ -4,7 +4,7 @@
 
 #include <cia.h>
 #include <interrupt.h>
-#include <notify.h>
+#include <sleepq.h>
 
 static List_t WaitingTasks;
 
@@ -47,9 +47,9 @@ static void LineCounterHandler(List_t *tasks) {
    * Wake up corresponding tasks. */
   uint32_t curr = GetCounter();
   while (listGET_ITEM_VALUE_OF_HEAD_ENTRY(tasks) <= curr) {
-    xTaskHandle task = listGET_OWNER_OF_HEAD_ENTRY(tasks);
-    uxListRemove(listGET_HEAD_ENTRY(tasks));
-    NotifySendFromISR(task, NB_IRQ);
+    ListItem_t *item = listGET_HEAD_ENTRY(tasks);
+    uxListRemove(item);
+    WakeupFromISR(item);
   }
 
   /* Reprogram TOD alarm if there's an item on list,
@@ -90,7 +90,8 @@ void LineCounterWait(uint32_t lines) {
     /* Reprogram TOD alarm if inserted task should be woken up as first. */
     if (listGET_HEAD_ENTRY(&WaitingTasks) == &item)
       SetAlarm(alarm);
-    (void)NotifyWait(NB_IRQ, portMAX_DELAY);
+    /* The task sleeps on its own list item. */
+    (void)Sleep(&item, portMAX_DELAY);
   }
   taskEXIT_CRITICAL();
 }
@@ -3,15 +3,15 @@
 
 #include <interrupt.h>
 #include <cia.h>
-#include <notify.h>
+#include <sleepq.h>
 
 /* Bitmask marking TIMER_* timers being in use. */
 static uint8_t InUse;
 
-/* Defines timer state after it has been acquired. */
+/* Defines timer state after it has been acquired.
+ * The task waiting for the timer to expire sleeps on the timer. */
 struct CIATimer {
   IntServer_t server;
-  volatile TaskHandle_t waiter;
   CIA_t cia;
   uint8_t icr;
   uint8_t num;
@@ -23,9 +23,8 @@ static void CIATimerHandler(CIATimer_t *timer) {
   uint8_t icr = timer->icr;
 
   if (SampleICR(cia, icr)) {
-    /* Wake up sleeping task and disable interrupt for the timer. */
-    NotifySendFromISR(timer->waiter, NB_IRQ);
-    timer->waiter = NULL;
+    /* Wake up sleeping task. */
+    WakeupFromISR(timer);
   }
 }
 
@@ -107,9 +106,11 @@ void WaitTimerGeneric(CIATimer_t *timer, uint16_t delay, bool spin) {
   } else {
     /* Must not sleep while in interrupt context! */
     configASSERT((portGetSR() & 0x0700) == 0);
-    /* Turn on the interrupt and go to sleep. */
-    timer->waiter = xTaskGetCurrentTaskHandle();
+    /* Turn on the interrupt and go to sleep. Interrupts are masked until we
+     * are asleep, so the wakeup cannot be lost. */
+    taskENTER_CRITICAL();
     WriteICR(cia, CIAICRF_SETCLR | icr);
-    (void)NotifyWait(NB_IRQ, portMAX_DELAY);
+    (void)Sleep(timer, portMAX_DELAY);
+    taskEXIT_CRITICAL();
   }
 }
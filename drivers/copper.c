@@ -2,7 +2,8 @@
 #include <memory.h>
 
 void CopListInit(CopList_t *list, uint16_t length) {
-  list->curr = list->list = MemAlloc(muls16(length, sizeof(CopIns_t)), MF_CHIP);
+  list->curr = list->list =
+    MemAlloc(muls16(length, sizeof(CopIns_t)), MF_CHIP | MF_TAG(MT_DISPLAY));
 }
 
 void CopListKill(CopList_t *list) {
@@ -1,5 +1,4 @@
 #include <FreeRTOS/FreeRTOS.h>
-#include <FreeRTOS/semphr.h>
 
 #include <bitmap.h>
 #include <copper.h>
@@ -13,6 +12,7 @@
 #include <devfile.h>
 #include <ioreq.h>
 #include <memory.h>
+#include <mutex.h>
 #include <string.h>
 #include <sys/errno.h>
 
@@ -33,7 +33,7 @@
 #define NROW (HEIGHT / FONT_H)
 
 typedef struct DisplayDev {
-  SemaphoreHandle_t lock;
+  Mutex_t lock;
   DevFile_t *file;
   struct {
     uint8_t *here;
@@ -109,8 +109,8 @@ static int DisplayOpen(DevFile_t *dev, FileFlags_t flags) {
     BitmapInit(&disp->bm, WIDTH, HEIGHT + FONT_H, DEPTH, 0);
 
     disp->rowsize = muls16(FONT_H, disp->bm.bytesPerRow);
-    disp->rowptr = MemAlloc(sizeof(void *) * (NROW + 1), 0);
-    disp->rowins = MemAlloc(sizeof(CopIns_t *) * NROW, 0);
+    disp->rowptr = MemAlloc(sizeof(void *) * (NROW + 1), MF_TAG(MT_DISPLAY));
+    disp->rowins = MemAlloc(sizeof(CopIns_t *) * NROW, MF_TAG(MT_DISPLAY));
 
     for (short i = 0; i < NROW + 1; i++)
       disp->rowptr[i] = disp->bm.planes[0] + muls16(i, disp->rowsize);
@@ -222,12 +222,12 @@ static void ControlCode(DisplayDev_t *disp, short c) {
 static int DisplayWrite(DevFile_t *dev, IoReq_t *req) {
   DisplayDev_t *disp = dev->data;
 
-  xSemaphoreTake(disp->lock, portMAX_DELAY);
+  MutexLock(&disp->lock);
 
   DisplayDrawCursor(disp);
 
-  for (; req->left; req->left--) {
-    uint8_t c = *req->wbuf++;
+  for (; req->left; IoReqAdvance(req, 1)) {
+    uint8_t c = *req->wbuf;
 
     if (ISCONTROL(c)) {
       ControlCode(disp, c);
@@ -240,7 +240,7 @@ static int DisplayWrite(DevFile_t *dev, IoReq_t *req) {
 
   DisplayDrawCursor(disp);
 
-  xSemaphoreGive(disp->lock);
+  MutexUnlock(&disp->lock);
 
   return 0;
 }
@@ -259,7 +259,7 @@ static int DisplayIoctl(DevFile_t *dev __unused, u_long cmd, void *data,
 static int DisplayAttach(Driver_t *drv) {
   DisplayDev_t *disp = drv->state;
 
-  disp->lock = xSemaphoreCreateMutex();
+  MutexInit(&disp->lock);
 
   int error;
   if ((error = AddDevFile("display", &DisplayOps, &disp->file)))
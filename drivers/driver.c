@@ -4,7 +4,7 @@
 #include <sys/errno.h>
 
 int DeviceAttach(Driver_t *drv) {
-  drv->state = MemAlloc(drv->size, MF_ZERO);
+  drv->state = MemAlloc(drv->size, MF_ZERO | MF_TAG(MT_DRIVER));
   if (!drv->state)
     return ENOMEM;
   Log("Attaching '%s' driver.\n", drv->name);
@@ -8,6 +8,7 @@
 #include <driver.h>
 #include <string.h>
 #include <devfile.h>
+#include <buf.h>
 #include <msgport.h>
 #include <notify.h>
 #include <ioreq.h>
@@ -20,6 +21,8 @@
 #define DEBUG 0
 #include <debug.h>
 
+#define FLOPPY_NREQS 8 /* maximum number of pending requests */
+
 typedef struct FloppyDev {
   DevFile_t *file;
   CIATimer_t *timer;
@@ -45,11 +48,16 @@ static void TrackTransferDone(void *ptr) {
 
 static void FloppyIoTask(void *);
 static int FloppyReadWrite(DevFile_t *, IoReq_t *);
+static int FloppyStrategy(Buf_t *);
+static void FloppyCancel(DevFile_t *, IoReq_t *);
 
 static DevFileOps_t FloppyOps = {
   .type = DT_DISK,
   .read = FloppyReadWrite,
   .write = FloppyReadWrite,
+  .strategy = FloppyStrategy,
+  .submit = FloppyReadWrite,
+  .cancel = FloppyCancel,
 };
 
 static int FloppyAttach(Driver_t *drv) {
@@ -72,8 +80,9 @@ static int FloppyAttach(Driver_t *drv) {
               FLOPPY_TASK_PRIO, &flp->ioTask);
   DASSERT(flp->ioTask != NULL);
 
-  flp->ioPort = MsgPortCreate(flp->ioTask);
-  flp->diskTrack = MemAlloc(DISK_TRACK_SIZE, MF_CHIP);
+  flp->ioPort = MsgPortCreate(flp->ioTask, FLOPPY_NREQS);
+  flp->diskTrack = MemAllocAligned(DISK_TRACK_SIZE, DISK_TRACK_ALIGN,
+                                   MF_CHIP | MF_TAG(MT_FLOPPY));
   flp->track = -1;
   DASSERT(flp->diskTrack != NULL);
 
@@ -82,6 +91,8 @@ static int FloppyAttach(Driver_t *drv) {
 
   flp->file->data = (void *)flp;
   flp->file->size = FLOPPY_SIZE;
+  /* The drive transfers whole tracks, so it's the natural unit to cache. */
+  flp->file->blksize = TRACK_SIZE;
   return 0;
 }
 
@@ -288,6 +299,102 @@ static int FloppyReadWriteTrack(FloppyDev_t *fd, short cmd, short track) {
   return 0;
 }
 
+/* Elevator algorithm: keep moving the heads in current direction while there
+ * are requests ahead of them, then reverse. Requests for the track that is
+ * already buffered and canceled requests go first. */
+static Msg_t *FloppyNextReq(FloppyDev_t *fd) {
+  Msg_t *best = NULL, *ahead = NULL;
+  int16_t bestDist = NTRACKS, aheadDist = NTRACKS;
+
+  for (Msg_t *msg = NextMsg(fd->ioPort, NULL); msg != NULL;
+       msg = NextMsg(fd->ioPort, msg)) {
+    IoReq_t *io = msg->data;
+    int16_t track = divs16(io->offset, TRACK_SIZE).quot;
+
+    if (track == fd->track || io->cancel)
+      return msg;
+
+    /* Distance in cylinders, positive if the request is ahead of heads. */
+    int16_t dist = (track >> 1) - (fd->headTrk >> 1);
+    if (fd->headDir < 0)
+      dist = -dist;
+
+    if (dist >= 0 && dist < aheadDist) {
+      ahead = msg;
+      aheadDist = dist;
+    }
+    if (abs(dist) < bestDist) {
+      best = msg;
+      bestDist = abs(dist);
+    }
+  }
+
+  return ahead ? ahead : best;
+}
+
+static int FloppyDoIo(FloppyDev_t *fd, IoReq_t *io) {
+  DLOG("[Floppy] %s(%d, %d)\n", io->write ? "Write" : "Read", io->offset,
+       io->left);
+
+  bool needWrite = false;
+  int16_t track = divs16(io->offset, TRACK_SIZE).quot;
+  int16_t sector = divs16(io->offset / SECTOR_SIZE, NSECTORS).rem;
+  int32_t offset = io->offset % SECTOR_SIZE;
+
+  /* The loop processes one sector at a time. */
+  while (io->left > 0) {
+    /* Submitter does not want the rest of data. */
+    if (io->cancel)
+      break;
+
+    /* if `trackBuf` stores another track or is empty,
+     * then we need to read a track */
+    if (fd->track != track)
+      FloppyReadWriteTrack(fd, READ, track);
+
+    /* let's see if sector we want to read from is decoded */
+    if (!(fd->sectorState[sector] & DECODED)) {
+      DecodeSector(fd->diskSector[sector], fd->rawSector[sector]);
+      fd->sectorState[sector] |= DECODED;
+    }
+
+    /* Read as much as you can, but do not cross sector boundary. */
+    size_t n = min(IoReqSegLen(io), SECTOR_SIZE - offset);
+
+    if (io->write) {
+      memcpy((void *)fd->rawSector[sector] + offset, io->wbuf, n);
+      needWrite = true;
+      fd->sectorState[sector] |= DIRTY;
+    } else {
+      memcpy(io->rbuf, (void *)fd->rawSector[sector] + offset, n);
+    }
+
+    IoReqAdvance(io, n);
+
+    /* Request buffer segment may end in the middle of a sector. */
+    if (n < SECTOR_SIZE - offset) {
+      offset += n;
+      continue;
+    }
+
+    /* We crossed sector boundary, so update sector / track counter. */
+    offset = 0;
+    if (++sector == NSECTORS) {
+      sector = 0;
+      if (needWrite) {
+        FloppyReadWriteTrack(fd, WRITE, track);
+        needWrite = false;
+      }
+      track++;
+    }
+  }
+
+  if (needWrite)
+    FloppyReadWriteTrack(fd, WRITE, track);
+
+  return io->left ? ECANCELED : 0;
+}
+
 static void FloppyIoTask(void *ptr) {
   FloppyDev_t *fd = ptr;
 
@@ -301,63 +408,12 @@ static void FloppyIoTask(void *ptr) {
       continue;
     }
 
-    IoReq_t *io = GetMsgData(fd->ioPort);
-    Assert(io != NULL);
-
-    DLOG("[Floppy] %s(%d, %d)\n", io->write ? "Write" : "Read", io->offset,
-         io->left);
-
-    bool needWrite = false;
-    int16_t track = divs16(io->offset, TRACK_SIZE).quot;
-    int16_t sector = divs16(io->offset / SECTOR_SIZE, NSECTORS).rem;
-    int32_t offset = io->offset % SECTOR_SIZE;
-
-    /* The loop processes one sector at a time. */
-    while (io->left > 0) {
-      /* if `trackBuf` stores another track or is empty,
-       * then we need to read a track */
-      if (fd->track != track)
-        FloppyReadWriteTrack(fd, READ, track);
-
-      /* let's see if sector we want to read from is decoded */
-      if (!(fd->sectorState[sector] & DECODED)) {
-        DecodeSector(fd->diskSector[sector], fd->rawSector[sector]);
-        fd->sectorState[sector] |= DECODED;
-      }
-
-      /* Read as much as you can, but do not cross sector boundary. */
-      size_t n = min(io->left, SECTOR_SIZE - offset);
-
-      if (io->write) {
-        memcpy((void *)fd->rawSector[sector] + offset, io->wbuf, n);
-        io->wbuf += n;
-        needWrite = true;
-        fd->sectorState[sector] |= DIRTY;
-      } else {
-        memcpy(io->rbuf, (void *)fd->rawSector[sector] + offset, n);
-        io->rbuf += n;
-      }
-
-      io->left -= n;
-
-      /* Assume we crossed sector boundary, otherwise we quit the loop anyway,
-       * and update sector / track counter appropriately. */
-      offset = 0;
-      if (++sector == NSECTORS) {
-        sector = 0;
-        if (needWrite) {
-          FloppyReadWriteTrack(fd, WRITE, track);
-          needWrite = false;
-        }
-        track++;
-      }
+    /* Serve all queued requests in order that minimizes head movement. */
+    Msg_t *msg;
+    while ((msg = FloppyNextReq(fd))) {
+      IoReq_t *io = msg->data;
+      IoReqReply(fd->ioPort, io, FloppyDoIo(fd, io));
     }
-
-    if (needWrite)
-      FloppyReadWriteTrack(fd, WRITE, track);
-
-    io->error = 0;
-    ReplyMsg(fd->ioPort);
   }
 }
 
@@ -367,10 +423,28 @@ static int FloppyReadWrite(DevFile_t *dev, IoReq_t *io) {
     return EINVAL;
   if (io->offset + io->left > FLOPPY_SIZE)
     io->left = FLOPPY_SIZE - io->offset;
-  if (io->left == 0)
+  if (io->left == 0) {
+    IoReqDone(io, 0);
     return 0;
-  DoMsg(fd->ioPort, &MSG(io));
-  return io->error;
+  }
+  return IoReqSend(fd->ioPort, io);
+}
+
+static int FloppyStrategy(Buf_t *bp) {
+  off_t offset = bp->blkno * TRACK_SIZE;
+  IoReq_t io = (bp->flags & B_WRITE)
+                 ? IOREQ_WRITE(offset, bp->data, bp->size, 0)
+                 : IOREQ_READ(offset, bp->data, bp->size, 0);
+  int error = FloppyReadWrite(bp->dev, &io);
+  if (!error && io.left > 0)
+    error = EIO;
+  return error;
+}
+
+static void FloppyCancel(DevFile_t *dev, IoReq_t *io __unused) {
+  FloppyDev_t *fd = dev->data;
+  /* Let I/O task find the request and complete it. */
+  NotifySend(fd->ioTask, NB_MSGPORT);
 }
 
 Driver_t Floppy = {
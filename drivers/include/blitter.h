@@ -71,6 +71,14 @@ static inline void WaitBlitter(void) {
     continue;
 }
 
+/* Blitter registers are shared by all tasks, so a task must own the blitter
+ * from the moment it starts programming them (i.e. *Setup routines) until its
+ * last blit has been started. Ownership cannot be nested. Next owner waits for
+ * the blit in progress before it touches the registers. Refer to AmigaOS
+ * graphics.library OwnBlitter and DisownBlitter. */
+void OwnBlitter(void);
+void DisownBlitter(void);
+
 /* Blitter copying state & routines. */
 typedef struct BltCopy {
   /* public fields */
@@ -111,9 +119,11 @@ static inline void BltCopySetDst(BltCopy_t *bc, const Bitmap_t *bm, short x,
 }
 
 static inline void BitmapCopy(BltCopy_t *bc) {
+  OwnBlitter();
   BltCopySetup(bc);
   for (int i = 0; i < min(bc->src.bm->depth, bc->dst.bm->depth); i++)
     BltCopy(bc, bc->dst.bm->planes[i], bc->src.bm->planes[i], bc->src.bm->mask);
+  DisownBlitter();
 }
 
 /* Line drawing modes. */
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <memory.h>
+
+/* Relocatable chip memory blocks are accessed through handles. Owners must
+ * lock a block to get its address and may use the address only while the
+ * block stays locked. Unlocked blocks may be moved by the allocator at any
+ * time to make space for new allocations. Code that needs fixed addresses,
+ * e.g. blocks handed over to DMA for an unbounded time, should either keep
+ * the block locked or use MemAlloc with MF_CHIP flag. */
+typedef struct ChipMem ChipMem_t;
+
+/* Reserves `size` bytes of chip memory to be managed by the allocator.
+ * Returns ENOMEM if there's not enough chip memory. */
+int ChipMemInit(size_t size);
+
+/* Allocate a relocatable block. Only MF_ZERO flag is recognized. If there's
+ * no free range large enough the zone is compacted first. Compaction uses the
+ * blitter, hence it must not be called by a task that owns the blitter. */
+ChipMem_t *ChipMemAlloc(size_t size, MemFlags_t flags);
+void ChipMemFree(ChipMem_t *cm);
+
+/* Locks can be nested. Block is movable again after the last unlock. */
+void *ChipMemLock(ChipMem_t *cm);
+void ChipMemUnlock(ChipMem_t *cm);
+
+/* Returns the number of free bytes in the zone. */
+size_t ChipMemAvail(void);
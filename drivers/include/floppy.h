@@ -20,6 +20,8 @@
 #include <sys/types.h>
 
 #define DISK_TRACK_SIZE 12800
+/* Track buffer alignment that guarantees it won't cross 16KiB boundary. */
+#define DISK_TRACK_ALIGN 16384
 #define DISK_GAP_SIZE 832
 
 typedef enum SectorState {
@@ -28,3 +28,4 @@ void InputEventQueueDelete(QueueHandle_t q);
 
 int InputEventInjectFromISR(QueueHandle_t q, const InputEvent_t *iev, size_t n);
 int InputEventRead(QueueHandle_t q, IoReq_t *io);
+bool InputEventReady(QueueHandle_t q);
@@ -1,5 +1,14 @@
 #pragma once
 
+#include <sys/ioctl.h>
+
 typedef struct DevFile DevFile_t;
+typedef struct Mbuf Mbuf_t;
+
+/* Raw console devices (DT_CONS) take output of the terminal as buffer chains.
+ * The device becomes the owner of the chain, sends the data straight from its
+ * buffers and releases them afterwards, so the line discipline can pass data
+ * on without copying it into the transmit ring. */
+#define CIOCTXCHAIN _IOW('C', 1, Mbuf_t *) /* queue chain for transmission */
 
 int AddTtyDevFile(const char *name, DevFile_t *cons);
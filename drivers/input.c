@@ -37,21 +37,25 @@ int InputEventInjectFromISR(QueueHandle_t q, const InputEvent_t *iev,
 int InputEventRead(QueueHandle_t q, IoReq_t *io) {
   size_t done = 0;
 
-  if (io->left < sizeof(InputEvent_t))
+  /* Events are never split between request buffer segments. */
+  if (IoReqSegLen(io) < sizeof(InputEvent_t))
     return EINVAL;
 
   do {
     if (xQueueReceive(q, io->rbuf,
                       (io->flags & F_NONBLOCK) ? 0 : portMAX_DELAY)) {
-      io->left -= sizeof(InputEvent_t);
-      io->rbuf += sizeof(InputEvent_t);
+      IoReqAdvance(io, sizeof(InputEvent_t));
       done++;
     } else if (done) {
       return 0;
     } else if (io->flags & F_NONBLOCK) {
       return EAGAIN;
     }
-  } while (io->left >= sizeof(InputEvent_t));
+  } while (IoReqSegLen(io) >= sizeof(InputEvent_t));
 
   return 0;
 }
+
+bool InputEventReady(QueueHandle_t q) {
+  return uxQueueMessagesWaiting(q) > 0;
+}
@@ -243,6 +243,7 @@ static int KeyboardOpen(DevFile_t *, FileFlags_t);
 static int KeyboardClose(DevFile_t *, FileFlags_t);
 static int KeyboardRead(DevFile_t *, IoReq_t *);
 static int KeyboardEvent(DevFile_t *, EvAction_t, EvFilter_t);
+static bool KeyboardReady(DevFile_t *, EvFilter_t);
 
 static DevFileOps_t KeyboardOps = {
   .type = DT_OTHER,
@@ -250,6 +251,7 @@ static DevFileOps_t KeyboardOps = {
   .close = KeyboardClose,
   .read = KeyboardRead,
   .event = KeyboardEvent,
+  .ready = KeyboardReady,
 };
 
 static int KeyboardOpen(DevFile_t *dev, FileFlags_t flags) {
@@ -296,6 +298,11 @@ static int KeyboardEvent(DevFile_t *dev, EvAction_t act, EvFilter_t filt) {
   return EINVAL;
 }
 
+static bool KeyboardReady(DevFile_t *dev, EvFilter_t filt) {
+  KeyboardDev_t *kbd = dev->data;
+  return filt == EVFILT_READ && InputEventReady(kbd->eventQ);
+}
+
 static void ReadKeyEvent(KeyboardDev_t *kbd, uint8_t raw) {
   DLOG("keyboard: reported raw code $%02x\n", raw);
 
@@ -29,10 +29,16 @@ static int MemoryOpen(DevFile_t *dev __unused, FileFlags_t flags) {
 }
 
 static int MemoryRead(DevFile_t *dev, IoReq_t *req) {
-  size_t n = req->left;
-  if (req->offset + (ssize_t)req->left > dev->size)
-    n = dev->size - req->offset;
-  memcpy(req->rbuf, dev->data + req->offset, n);
-  req->left -= n;
+  off_t offset = req->offset;
+  size_t left = req->left;
+  if (offset + (ssize_t)left > dev->size)
+    left = dev->size - offset;
+  while (left > 0) {
+    size_t n = min(IoReqSegLen(req), left);
+    memcpy(req->rbuf, dev->data + offset, n);
+    IoReqAdvance(req, n);
+    offset += n;
+    left -= n;
+  }
   return 0;
 }
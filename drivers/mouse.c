@@ -25,6 +25,7 @@ static int MouseOpen(DevFile_t *, FileFlags_t);
 static int MouseClose(DevFile_t *, FileFlags_t);
 static int MouseRead(DevFile_t *, IoReq_t *);
 static int MouseEvent(DevFile_t *, EvAction_t, EvFilter_t);
+static bool MouseReady(DevFile_t *, EvFilter_t);
 
 static DevFileOps_t MouseOps = {
   .type = DT_OTHER,
@@ -32,6 +33,7 @@ static DevFileOps_t MouseOps = {
   .close = MouseClose,
   .read = MouseRead,
   .event = MouseEvent,
+  .ready = MouseReady,
 };
 
 static uint8_t ReadButtonState(void) {
@@ -87,6 +89,11 @@ static int MouseEvent(DevFile_t *dev, EvAction_t act, EvFilter_t filt) {
   return EINVAL;
 }
 
+static bool MouseReady(DevFile_t *dev, EvFilter_t filt) {
+  MouseDev_t *ms = dev->data;
+  return filt == EVFILT_READ && InputEventReady(ms->eventQ);
+}
+
 static void MouseIntHandler(void *data) {
   MouseDev_t *ms = data;
   static InputEvent_t ev[4];
@@ -1,32 +1,43 @@
 #include <FreeRTOS/FreeRTOS.h>
-#include <FreeRTOS/semphr.h>
+#include <FreeRTOS/task.h>
 
 #include <custom.h>
 #include <interrupt.h>
 #include <driver.h>
 #include <ring.h>
+#include <mbuf.h>
 #include <event.h>
-#include <notify.h>
+#include <sleepq.h>
+#include <mutex.h>
 #include <memory.h>
 #include <ioreq.h>
 #include <devfile.h>
+#include <file.h>
+#include <tty.h>
 #include <sys/errno.h>
 
 #define DEBUG 0
 #include <debug.h>
 
 #define CLOCK 3546895
-#define BUFLEN 64
+#define BUFLEN 64 /* must be a power of two */
+#define TXLOWAT 128 /* writable while at most that many chain bytes wait */
 
 typedef struct SerialDev {
   DevFile_t *file;
   IntServer_t intr;
-  SemaphoreHandle_t rxLock;
-  SemaphoreHandle_t txLock;
-  Ring_t *rxBuf;
-  Ring_t *txBuf;
-  TaskHandle_t rxTask;
-  TaskHandle_t txTask;
+  Mutex_t rxLock;
+  Mutex_t txLock;
+  Ring_t *rxBuf; /* reader sleeps on it waiting for data */
+  Ring_t *txBuf; /* writer sleeps on it waiting for the data to be sent */
+  /* Chains queued with CIOCTXCHAIN are sent before the transmit ring, so
+   * terminal output that was handed over is not overtaken by direct writes.
+   * Bytes that already sit in the ring wait for queued chains to drain. */
+  Mbuf_t *txHead;           /* buffer being sent */
+  Mbuf_t *txTail;           /* last buffer queued */
+  Mbuf_t *txSent;           /* buffers sent, to be released by a task */
+  volatile size_t txQueued; /* bytes left in queued chains */
+  bool txWake;              /* wake up writers on next TBE interrupt */
   EventWaitList_t readEvent;
   EventWaitList_t writeEvent;
   unsigned baud;
@@ -36,7 +47,9 @@ static int SerialOpen(DevFile_t *, FileFlags_t);
 static int SerialClose(DevFile_t *, FileFlags_t);
 static int SerialRead(DevFile_t *, IoReq_t *);
 static int SerialWrite(DevFile_t *, IoReq_t *);
+static int SerialIoctl(DevFile_t *, u_long, void *, FileFlags_t);
 static int SerialEvent(DevFile_t *, EvAction_t, EvFilter_t);
+static bool SerialReady(DevFile_t *, EvFilter_t);
 
 static DevFileOps_t SerialOps = {
   .type = DT_CONS,
@@ -44,9 +57,41 @@ static DevFileOps_t SerialOps = {
   .close = SerialClose,
   .read = SerialRead,
   .write = SerialWrite,
+  .ioctl = SerialIoctl,
   .event = SerialEvent,
+  .ready = SerialReady,
 };
 
+/* Returns next byte to be sent or -1 if there's none. Writers are to be woken
+ * up when the transmit ring drains or queued chains drop to TXLOWAT bytes.
+ * Must be called with interrupts masked. */
+static int SerialNextByte(SerialDev_t *ser) {
+  Mbuf_t *m;
+
+  while ((m = ser->txHead) != NULL) {
+    if (m->len > 0) {
+      m->len--;
+      if (--ser->txQueued == TXLOWAT)
+        ser->txWake = true;
+      return *m->data++;
+    }
+    /* Buffers cannot be released by an interrupt handler. */
+    if (!(ser->txHead = m->next))
+      ser->txTail = NULL;
+    m->next = ser->txSent;
+    ser->txSent = m;
+  }
+
+  if (!RingEmpty(ser->txBuf)) {
+    uint8_t byte = RingGetByte(ser->txBuf);
+    if (RingEmpty(ser->txBuf))
+      ser->txWake = true;
+    return byte;
+  }
+
+  return -1;
+}
+
 /* Handles full-duplex transmission. */
 static void SerialTransmit(SerialDev_t *ser) {
   uint32_t ulSavedInterruptMask = portSET_INTERRUPT_MASK_FROM_ISR();
@@ -61,11 +106,13 @@ static void SerialTransmit(SerialDev_t *ser) {
       done++;
     }
 
-    if ((serdat & (SERDATF_TBE | SERDATF_TSRE)) && !RingEmpty(ser->txBuf)) {
-      uint8_t byte = RingGetByte(ser->txBuf);
-      /* Send one byte into the wire. */
-      custom.serdat = (uint16_t)(byte) | (uint16_t)0x100;
-      done++;
+    if (serdat & (SERDATF_TBE | SERDATF_TSRE)) {
+      int byte = SerialNextByte(ser);
+      if (byte >= 0) {
+        /* Send one byte into the wire. */
+        custom.serdat = (uint16_t)(byte) | (uint16_t)0x100;
+        done++;
+      }
     }
 
     if (!done)
@@ -78,14 +125,13 @@ static void SerialTransmit(SerialDev_t *ser) {
 static void SendIntHandler(void *ptr) {
   SerialDev_t *ser = ptr;
   SerialTransmit(ser);
-  if (RingEmpty(ser->txBuf)) {
-    if (ser->txTask) {
-      NotifySendFromISR(ser->txTask, NB_IRQ);
+  if (ser->txWake) {
+    ser->txWake = false;
+    /* The terminal may wait for the event while a writer sleeps. */
+    if (WakeupOneFromISR(ser->txBuf))
       DLOG("serial: writer wakeup!\n");
-    } else {
-      EventNotifyFromISR(&ser->writeEvent);
-      DLOG("serial: notify write listeners!\n");
-    }
+    EventNotifyFromISR(&ser->writeEvent);
+    DLOG("serial: notify write listeners!\n");
   }
 }
 
@@ -93,13 +139,10 @@ static void RecvIntHandler(void *ptr) {
   SerialDev_t *ser = ptr;
   SerialTransmit(ser);
   if (!RingEmpty(ser->rxBuf)) {
-    if (ser->rxTask) {
-      NotifySendFromISR(ser->rxTask, NB_IRQ);
+    if (WakeupOneFromISR(ser->rxBuf))
       DLOG("serial: reader wakeup!\n");
-    } else {
-      EventNotifyFromISR(&ser->readEvent);
-      DLOG("serial: notify read listeners!\n");
-    }
+    EventNotifyFromISR(&ser->readEvent);
+    DLOG("serial: notify read listeners!\n");
   }
 }
 
@@ -128,10 +171,12 @@ static int SerialOpen(DevFile_t *dev, FileFlags_t flags __unused) {
 
     custom.serper = CLOCK / ser->baud - 1;
 
-    ser->rxLock = xSemaphoreCreateMutex();
-    ser->txLock = xSemaphoreCreateMutex();
-    ser->rxBuf = RingAlloc(BUFLEN);
-    ser->txBuf = RingAlloc(BUFLEN);
+    MutexInit(&ser->rxLock);
+    MutexInit(&ser->txLock);
+    ser->rxBuf = RingAlloc(BUFLEN, MF_TAG(MT_KERNEL));
+    ser->txBuf = RingAlloc(BUFLEN, MF_TAG(MT_KERNEL));
+    ser->txHead = ser->txTail = ser->txSent = NULL;
+    ser->txQueued = 0;
 
     SetIntVec(TBE, SendIntHandler, ser);
     SetIntVec(RBF, RecvIntHandler, ser);
@@ -157,9 +202,8 @@ static int SerialClose(DevFile_t *dev, FileFlags_t flags __unused) {
 
     MemFree(ser->rxBuf);
     MemFree(ser->txBuf);
-
-    vSemaphoreDelete(ser->rxLock);
-    vSemaphoreDelete(ser->txLock);
+    MbufFreeChain(ser->txHead);
+    MbufFreeChain(ser->txSent);
   }
 
   return 0;
@@ -172,14 +216,13 @@ static int SerialWrite(DevFile_t *dev, IoReq_t *req) {
 
   Assert(n > 0);
 
-  xSemaphoreTake(ser->txLock, portMAX_DELAY);
-  taskENTER_CRITICAL();
-
-  ser->txTask = xTaskGetCurrentTaskHandle();
+  MutexLock(&ser->txLock);
 
   /* Write all data to transmit buffer. This may involve waiting for the
-   * interupt handler to free enough space in the ring buffer. */
-  do {
+   * interupt handler to free enough space in the ring buffer. The buffer has
+   * a single producer and a single consumer, so the copy runs with interrupts
+   * enabled. Only SerialTransmit masks them while it touches the hardware. */
+  for (;;) {
     RingWrite(ser->txBuf, req);
     SerialTransmit(ser);
     if (!req->left)
@@ -193,13 +236,16 @@ static int SerialWrite(DevFile_t *dev, IoReq_t *req) {
       error = EAGAIN;
       break;
     }
-  } while (NotifyWait(NB_IRQ, portMAX_DELAY));
-
-  ser->txTask = NULL;
+    /* Interrupt handler wakes us up once it has sent all data. Check it with
+     * interrupts masked, otherwise the wakeup could be lost. */
+    taskENTER_CRITICAL();
+    if (!RingEmpty(ser->txBuf))
+      (void)Sleep(ser->txBuf, portMAX_DELAY);
+    taskEXIT_CRITICAL();
+  }
 
   DLOG("serial: write request done; wrote %d bytes!\n", n - req->left);
-  taskEXIT_CRITICAL();
-  xSemaphoreGive(ser->txLock);
+  MutexUnlock(&ser->txLock);
 
   return error;
 }
@@ -209,12 +255,11 @@ static int SerialRead(DevFile_t *dev, IoReq_t *req) {
   int error = 0;
   __unused size_t n = req->left;
 
-  xSemaphoreTake(ser->rxLock, portMAX_DELAY);
-  taskENTER_CRITICAL();
-
-  ser->rxTask = xTaskGetCurrentTaskHandle();
+  MutexLock(&ser->rxLock);
 
-  /* Wait for the interrupt handler to put data into the ring buffer. */
+  /* Wait for the interrupt handler to put data into the ring buffer. The
+   * buffer is checked with interrupts masked, so the wakeup cannot be lost. */
+  taskENTER_CRITICAL();
   while (RingEmpty(ser->rxBuf)) {
     /* Nonblocking mode: if there's no data in the ring buffer signify that
      * we would have blocked and leave. */
@@ -222,21 +267,57 @@ static int SerialRead(DevFile_t *dev, IoReq_t *req) {
       error = EAGAIN;
       break;
     }
-    (void)NotifyWait(NB_IRQ, portMAX_DELAY);
+    (void)Sleep(ser->rxBuf, portMAX_DELAY);
   }
-
-  ser->rxTask = NULL;
+  taskEXIT_CRITICAL();
 
   if (!error)
     RingRead(ser->rxBuf, req);
 
   DLOG("serial: rx request done; read %d bytes!\n", n - req->left);
-  taskEXIT_CRITICAL();
-  xSemaphoreGive(ser->rxLock);
+  MutexUnlock(&ser->rxLock);
 
   return error;
 }
 
+/* Takes over chain `m` and starts sending it out. Releases buffers that the
+ * interrupt handler is done with. */
+static void SerialQueueChain(SerialDev_t *ser, Mbuf_t *m) {
+  size_t len = MbufChainLen(m);
+  Mbuf_t *last = m;
+
+  while (last->next)
+    last = last->next;
+
+  uint32_t ulSavedInterruptMask = portSET_INTERRUPT_MASK_FROM_ISR();
+  if (ser->txTail)
+    ser->txTail->next = m;
+  else
+    ser->txHead = m;
+  ser->txTail = last;
+  ser->txQueued += len;
+  Mbuf_t *sent = ser->txSent;
+  ser->txSent = NULL;
+  portCLEAR_INTERRUPT_MASK_FROM_ISR(ulSavedInterruptMask);
+
+  MbufFreeChain(sent);
+  SerialTransmit(ser);
+}
+
+static int SerialIoctl(DevFile_t *dev, u_long cmd, void *data,
+                       FileFlags_t flags) {
+  SerialDev_t *ser = dev->data;
+
+  if (cmd == CIOCTXCHAIN) {
+    if (!(flags & F_WRITE))
+      return EBADF;
+    SerialQueueChain(ser, *(Mbuf_t **)data);
+    return 0;
+  }
+
+  return EINVAL;
+}
+
 static int SerialEvent(DevFile_t *dev, EvAction_t act, EvFilter_t filt) {
   SerialDev_t *ser = dev->data;
 
@@ -247,6 +328,16 @@ static int SerialEvent(DevFile_t *dev, EvAction_t act, EvFilter_t filt) {
   return EINVAL;
 }
 
+static bool SerialReady(DevFile_t *dev, EvFilter_t filt) {
+  SerialDev_t *ser = dev->data;
+
+  if (filt == EVFILT_READ)
+    return !RingEmpty(ser->rxBuf);
+  if (filt == EVFILT_WRITE)
+    return !RingFull(ser->txBuf) && ser->txQueued <= TXLOWAT;
+  return false;
+}
+
 static int SerialAttach(Driver_t *drv) {
   SerialDev_t *ser = drv->state;
 
@@ -8,6 +8,7 @@
 #include <event.h>
 #include <notify.h>
 #include <ioreq.h>
+#include <mbuf.h>
 #include <memory.h>
 #include <string.h>
 #include <sys/errno.h>
@@ -35,6 +36,7 @@
  */
 
 #define BUFSIZ 256
+#define OUTMAX 512 /* output gathered before it's handed to the device */
 
 /* Input buffer handles line editing. */
 typedef struct InputQueue {
@@ -44,19 +46,14 @@ typedef struct InputQueue {
   size_t done;      /* number of characters processed */
 } InputQueue_t;
 
-/* Output buffer state after character processing. */
-typedef struct OutputQueue {
-  char buf[BUFSIZ]; /* circular buffer data */
-  size_t len;       /* number of bytes in `buf` that are used */
-  size_t head;      /* index of first free byte in `buf` */
-  size_t tail;      /* index of first valid byte in `buf` */
-} OutputQueue_t;
-
 typedef struct TtyState {
   TaskHandle_t task;
   const char *name;
   InputQueue_t *input;
-  OutputQueue_t *output;
+  Mbuf_t *output;  /* processed output not yet passed to terminal device */
+  Mbuf_t *outTail; /* last buffer of `output` chain */
+  size_t outLen;   /* number of bytes in `output` chain */
+  bool crDone;     /* CR of CR + LF pair was stored for current LF */
   /* Used for communication with file-like objects. */
   MsgPort_t *ctrlMp;
   MsgPort_t *readMp;
@@ -65,24 +62,27 @@ typedef struct TtyState {
   const char *consName;
   File_t *cons;
   IoReq_t rxReq;
-  IoReq_t txReq;
 } TtyState_t;
 
 static void TtyTask(void *);
 static int TtyOpen(DevFile_t *, FileFlags_t);
 static int TtyClose(DevFile_t *, FileFlags_t);
-static int TtyRead(DevFile_t *, IoReq_t *);
-static int TtyWrite(DevFile_t *, IoReq_t *);
+static int TtyReadWrite(DevFile_t *, IoReq_t *);
+static int TtySubmit(DevFile_t *, IoReq_t *);
+static void TtyCancel(DevFile_t *, IoReq_t *);
 
 static DevFileOps_t TtyOps = {
   .type = DT_TTY,
   .open = TtyOpen,
   .close = TtyClose,
-  .read = TtyRead,
-  .write = TtyWrite,
+  .read = TtyReadWrite,
+  .write = TtyReadWrite,
+  .submit = TtySubmit,
+  .cancel = TtyCancel,
 };
 
 #define TTY_TASK_PRIO 2
+#define TTY_NREQS 4 /* maximum number of pending read or write requests */
 
 int AddTtyDevFile(const char *name, DevFile_t *cons) {
   DevFile_t *dev;
@@ -91,7 +91,7 @@ int AddTtyDevFile(const char *name, DevFile_t *cons) {
   if (cons->ops->type != DT_CONS)
     return ENXIO;
 
-  if (!(tty = MemAlloc(sizeof(TtyState_t), MF_ZERO)))
+  if (!(tty = MemAlloc(sizeof(TtyState_t), MF_ZERO | MF_TAG(MT_TTY))))
     return ENOMEM;
 
   tty->name = name;
@@ -114,10 +114,10 @@ static int HandleRxReady(TtyState_t *tty) {
   InputQueue_t *input = tty->input;
   int error = 0;
 
-  /* Append read characters at the end of line buffer. */
-  while (input->len < BUFSIZ) {
-    req->rbuf = input->buf + input->len;
-    req->left = BUFSIZ - input->len;
+  /* Append read characters at the end of line buffer. Do not bother trying
+   * to read from console that has no data. */
+  while (input->len < BUFSIZ && FileReady(cons, EVFILT_READ)) {
+    IoReqSetBuf(req, input->buf + input->len, BUFSIZ - input->len);
     if ((error = cons->ops->read(cons, req))) {
       DLOG("tty: rx-ready; would block\n");
       break;
@@ -131,10 +131,11 @@ static int HandleRxReady(TtyState_t *tty) {
   return error;
 }
 
-static void HandleReadReq(TtyState_t *tty) {
+/* Returns true if the oldest read request was replied. */
+static bool HandleReadReq(TtyState_t *tty) {
   IoReq_t *req = GetMsgData(tty->readMp);
   if (req == NULL)
-    return;
+    return false;
 
   InputQueue_t *input = tty->input;
 
@@ -142,20 +143,23 @@ static void HandleReadReq(TtyState_t *tty) {
   size_t n = (input->len == BUFSIZ) ? BUFSIZ : input->eol;
 
   if (n == 0)
-    return;
+    return false;
 
   /* All characters typed in by the user must be processed before
    * they are removed from the line buffer. */
   if (n < input->done)
-    return;
+    return false;
 
   if (req->left < n)
     n = req->left;
 
-  /* Copy data into I/O request buffer. */
-  memcpy(req->rbuf, input->buf, n);
-  req->rbuf += n;
-  req->left -= n;
+  /* Copy data into I/O request buffer segment by segment. */
+  for (size_t done = 0; done < n;) {
+    size_t len = min(IoReqSegLen(req), n - done);
+    memcpy(req->rbuf, input->buf + done, len);
+    IoReqAdvance(req, len);
+    done += len;
+  }
 
   /* Update state of the line. */
   if (n < input->len)
@@ -165,109 +169,158 @@ static void HandleReadReq(TtyState_t *tty) {
   input->done -= n;
 
   /* The request was handled, so return it to the owner. */
-  ReplyMsg(tty->readMp);
+  IoReqReply(tty->readMp, req, 0);
   DLOG("tty: replied read request\n");
+  return true;
 }
 
-static int HandleTxReady(TtyState_t *tty) {
-  File_t *cons = tty->cons;
-  IoReq_t *req = &tty->txReq;
-  OutputQueue_t *output = tty->output;
-  int error = 0;
-
-  if (output->len > 0)
-    DLOG("tty: tx-ready; output len %d\n", output->len);
-
-  while (output->len > 0) {
-    /* Used space is either [tail, head) or [tail, BUFSIZ) */
-    size_t size = (output->tail < output->head) ? output->head - output->tail
-                                                : BUFSIZ - output->tail;
-
-    /* Send asynchronous write request. */
-    req->wbuf = &output->buf[output->tail];
-    req->left = size;
-    if ((error = cons->ops->write(cons, req))) {
-      DLOG("tty: tx-ready; would block\n");
-      break;
-    }
+/* Passes gathered output to the terminal device, which takes over buffers of
+ * the chain, so the data is not copied again. */
+static void HandleTxReady(TtyState_t *tty) {
+  Mbuf_t *m = tty->output;
+  if (m != NULL) {
+    DLOG("tty: tx-ready; output len %d\n", tty->outLen);
+    tty->output = tty->outTail = NULL;
+    tty->outLen = 0;
+    FileIoctl(tty->cons, CIOCTXCHAIN, &m);
+  }
+}
 
-    /* Update tail position. */
-    size_t done = size - req->left;
-    output->tail += done;
-    if (output->tail == BUFSIZ)
-      output->tail = 0;
-    output->len -= done;
+static void OutputAppend(TtyState_t *tty, Mbuf_t *m) {
+  if (tty->outTail)
+    tty->outTail->next = m;
+  else
+    tty->output = m;
+  tty->outTail = m;
+  tty->outLen += m->len;
+}
 
-    DLOG("tty: tx-ready; output len %d\n", output->len);
+/* Returns space for at least `need` bytes at the end of output chain and its
+ * size in `lenp`. Returns NULL if there's no memory for another buffer. */
+static uint8_t *OutputReserve(TtyState_t *tty, size_t need, size_t *lenp) {
+  Mbuf_t *m = tty->outTail;
+  if (m == NULL || MbufTrailing(m) < need) {
+    if (!(m = MbufAlloc()))
+      return NULL;
+    OutputAppend(tty, m);
   }
+  *lenp = MbufTrailing(m);
+  return m->data + m->len;
+}
 
-  return error;
+/* Publishes `n` bytes stored into space returned by OutputReserve. */
+static void OutputCommit(TtyState_t *tty, size_t n) {
+  tty->outTail->len += n;
+  tty->outLen += n;
+}
+
+/* Returns true if more output can be gathered. */
+static bool OutputReady(TtyState_t *tty) {
+  return tty->outLen < OUTMAX && FileReady(tty->cons, EVFILT_WRITE);
 }
 
-static void StoreChar(OutputQueue_t *output, uint8_t c) {
-  DASSERT(output->len < BUFSIZ);
-  output->buf[output->head++] = c;
-  output->len++;
-  if (output->head == BUFSIZ)
-    output->head = 0;
+static bool HasNewline(const char *s, size_t n) {
+  while (n-- > 0)
+    if (*s++ == '\n')
+      return true;
+  return false;
 }
 
-static int HandleWriteReq(TtyState_t *tty) {
+/* Characters are processed directly into buffers of output chain. Segments
+ * of chain requests that need no processing are shared instead of copied.
+ * Returns true if the oldest write request was replied. */
+static bool HandleWriteReq(TtyState_t *tty) {
   IoReq_t *req = GetMsgData(tty->writeMp);
   if (req == NULL)
-    return 0;
-
-  OutputQueue_t *output = tty->output;
+    return false;
 
   while (req->left > 0) {
-    uint8_t ch = *req->wbuf;
-    if (ch == '\n') {
-      /* Turn LF into CR + LF */
-      if (output->len + 2 > BUFSIZ)
-        return EAGAIN;
-      StoreChar(output, '\r');
-    } else {
-      if (output->len + 1 > BUFSIZ)
-        return EAGAIN;
+    uint8_t *ptr;
+    size_t len, n = 0;
+
+    if (!OutputReady(tty))
+      return false;
+
+    len = IoReqSegLen(req);
+    if (req->mbuf && !HasNewline(req->wbuf, len)) {
+      Mbuf_t *m = MbufShare(req->mbuf, req->wbuf, len);
+      if (m == NULL)
+        return false;
+      OutputAppend(tty, m);
+      tty->crDone = false;
+      IoReqAdvance(req, len);
+      continue;
+    }
+
+    if (!(ptr = OutputReserve(tty, 1, &len)))
+      return false;
+
+    while (n < len && req->left > 0) {
+      uint8_t ch = *req->wbuf;
+      if (ch == '\n' && !tty->crDone) {
+        /* Turn LF into CR + LF */
+        ptr[n++] = '\r';
+        tty->crDone = true;
+        continue;
+      }
+      ptr[n++] = ch;
+      tty->crDone = false;
+      IoReqAdvance(req, 1);
     }
-    StoreChar(output, ch);
-    req->wbuf++;
-    req->left--;
+
+    OutputCommit(tty, n);
   }
 
   /* The request was handled, so return it to the owner. */
-  ReplyMsg(tty->writeMp);
+  IoReqReply(tty->writeMp, req, 0);
   DLOG("tty: replied write request\n");
-  return 0;
+  return true;
 }
 
 /* Perform character echoing. */
 static void ProcessInput(TtyState_t *tty) {
   InputQueue_t *input = tty->input;
-  OutputQueue_t *output = tty->output;
+  uint8_t *out;
+  size_t len, n;
 
   DASSERT(input->done <= input->len);
 
-  while (input->done < input->len && output->len < BUFSIZ) {
+  /* Each character is echoed as at most two characters. */
+  while (input->done < input->len && tty->outLen < OUTMAX &&
+         (out = OutputReserve(tty, 2, &len))) {
     uint8_t *ch = (uint8_t *)&input->buf[input->done++];
+    n = 0;
     if (*ch == '\r') {
       /* Replace '\r' by '\n', but output '\r\n'. */
       *ch = '\n';
-      StoreChar(output, '\r');
-      StoreChar(output, '\n');
+      out[n++] = '\r';
+      out[n++] = '\n';
       input->eol = input->done;
     } else if (*ch < 32) {
       /* Translate control codes to ASCII characters prefixed with '^' */
-      StoreChar(output, '^');
-      StoreChar(output, *ch + 64);
+      out[n++] = '^';
+      out[n++] = *ch + 64;
     } else if (*ch == 127) {
       /* Translate DEL character to '^?'. */
-      StoreChar(output, '^');
-      StoreChar(output, '?');
+      out[n++] = '^';
+      out[n++] = '?';
     } else {
       /* Just echo the character. */
-      StoreChar(output, *ch);
+      out[n++] = *ch;
     }
+    OutputCommit(tty, n);
+  }
+}
+
+/* Completes requests that submitters asked to abort. */
+static void HandleCanceled(MsgPort_t *mp) {
+  Msg_t *msg, *next;
+
+  for (msg = NextMsg(mp, NULL); msg != NULL; msg = next) {
+    next = NextMsg(mp, msg);
+    IoReq_t *req = msg->data;
+    if (req->cancel)
+      IoReqReply(mp, req, ECANCELED);
   }
 }
 
@@ -285,10 +338,15 @@ static void TtyTask(void *data) {
     if (GetMsgData(tty->ctrlMp) == QUIT)
       break;
 
+    HandleCanceled(tty->readMp);
+    HandleCanceled(tty->writeMp);
     HandleRxReady(tty);
     ProcessInput(tty);
-    HandleReadReq(tty);
-    HandleWriteReq(tty);
+    /* Serve as many queued requests as possible. */
+    while (HandleReadReq(tty))
+      continue;
+    while (HandleWriteReq(tty))
+      continue;
     HandleTxReady(tty);
     DLOG("tty: sleep\n");
   }
@@ -297,10 +355,15 @@ static void TtyTask(void *data) {
   FileEvent(tty->cons, EV_DELETE, EVFILT_WRITE);
 
   /* Abort pending requests. */
-  if (GetMsgData(tty->readMp))
-    ReplyMsg(tty->readMp);
-  if (GetMsgData(tty->writeMp))
-    ReplyMsg(tty->writeMp);
+  IoReq_t *req;
+  while ((req = GetMsgData(tty->readMp)))
+    IoReqReply(tty->readMp, req, 0);
+  while ((req = GetMsgData(tty->writeMp)))
+    IoReqReply(tty->writeMp, req, 0);
+
+  MbufFreeChain(tty->output);
+  tty->output = tty->outTail = NULL;
+  tty->outLen = 0;
 
   /* Unblock `TtyClose` and exit task. */
   ReplyMsg(tty->ctrlMp);
@@ -314,17 +377,17 @@ static int TtyOpen(DevFile_t *dev, FileFlags_t flags __unused) {
     if (error)
       return error;
 
-    tty->input = MemAlloc(sizeof(InputQueue_t), MF_ZERO);
-    tty->output = MemAlloc(sizeof(OutputQueue_t), MF_ZERO);
+    tty->input = MemAlloc(sizeof(InputQueue_t), MF_ZERO | MF_TAG(MT_TTY));
+    tty->crDone = false;
 
     xTaskCreate((TaskFunction_t)TtyTask, tty->name, configMINIMAL_STACK_SIZE,
                 tty, TTY_TASK_PRIO, &tty->task);
 
-    tty->ctrlMp = MsgPortCreate(tty->task);
-    tty->readMp = MsgPortCreate(tty->task);
-    tty->writeMp = MsgPortCreate(tty->task);
+    tty->ctrlMp = MsgPortCreate(tty->task, 1);
+    tty->readMp = MsgPortCreate(tty->task, TTY_NREQS);
+    tty->writeMp = MsgPortCreate(tty->task, TTY_NREQS);
 
-    tty->rxReq.flags = tty->txReq.flags = F_NONBLOCK;
+    tty->rxReq.flags = F_NONBLOCK;
   }
 
   return 0;
@@ -341,7 +404,6 @@ static int TtyClose(DevFile_t *dev, FileFlags_t flags __unused) {
     MsgPortDelete(tty->readMp);
     MsgPortDelete(tty->writeMp);
 
-    MemFree(tty->output);
     MemFree(tty->input);
 
     FileClose(tty->cons);
@@ -350,20 +412,21 @@ static int TtyClose(DevFile_t *dev, FileFlags_t flags __unused) {
   return ENOSYS;
 }
 
-static int TtyRead(DevFile_t *dev, IoReq_t *req) {
+/* Queues the request at the terminal task. Asynchronous requests are
+ * completed by the task, otherwise the caller waits for the reply. */
+static int TtySubmit(DevFile_t *dev, IoReq_t *req) {
   TtyState_t *tty = dev->data;
-  size_t n = req->left;
-
-  DoMsg(tty->readMp, &MSG(req));
-
-  return req->left < n ? 0 : req->error;
+  return IoReqSend(req->write ? tty->writeMp : tty->readMp, req);
 }
 
-static int TtyWrite(DevFile_t *dev, IoReq_t *req) {
-  TtyState_t *tty = dev->data;
+static int TtyReadWrite(DevFile_t *dev, IoReq_t *req) {
   size_t n = req->left;
+  int error = TtySubmit(dev, req);
+  return req->left < n ? 0 : error;
+}
 
-  DoMsg(tty->writeMp, &MSG(req));
-
-  return req->left < n ? 0 : req->error;
+static void TtyCancel(DevFile_t *dev, IoReq_t *req __unused) {
+  TtyState_t *tty = dev->data;
+  /* Let the terminal task find the request and complete it. */
+  NotifySend(tty->task, NB_MSGPORT);
 }
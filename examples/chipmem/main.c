@@ -0,0 +1,146 @@
+#include <FreeRTOS/FreeRTOS.h>
+#include <FreeRTOS/task.h>
+
+#include <custom.h>
+#include <interrupt.h>
+#include <debug.h>
+#include <bitmap.h>
+#include <blitter.h>
+#include <chipmem.h>
+#include <memory.h>
+
+#define TASK_PRIORITY 1
+
+#define ZONESZ 16384
+#define NBLOCKS 24
+#define NROUNDS 32
+
+static ChipMem_t *Block[NBLOCKS];
+static Bitmap_t Src, Dst;
+static volatile bool Done;
+
+/* Large blocks are moved by the blitter and small ones by the CPU. */
+static size_t BlockSize(int i) {
+  return (i & 1) ? 96 : 512;
+}
+
+static uint16_t Pattern(int i, int j) {
+  return (i << 12) ^ j;
+}
+
+static void BlockFill(int i) {
+  uint16_t *data = ChipMemLock(Block[i]);
+  for (size_t j = 0; j < BlockSize(i) / sizeof(uint16_t); j++)
+    data[j] = Pattern(i, j);
+  ChipMemUnlock(Block[i]);
+}
+
+static void BlockCheck(int i) {
+  uint16_t *data = ChipMemLock(Block[i]);
+  for (size_t j = 0; j < BlockSize(i) / sizeof(uint16_t); j++)
+    if (data[j] != Pattern(i, j))
+      Panic("chipmem: block %d damaged at word %d!", i, j);
+  ChipMemUnlock(Block[i]);
+}
+
+/* Keeps the blitter busy, so that compaction competes with another user. */
+static void vBlitTask(__unused void *data) {
+  BltCopy_t bc;
+
+  BltCopySetSrc(&bc, &Src, 0, 0, -1, -1);
+  BltCopySetDst(&bc, &Dst, 0, 0);
+
+  while (!Done)
+    BitmapCopy(&bc);
+
+  vTaskDelete(NULL);
+}
+
+/* Fragments the zone by freeing every other block, so that a large block fits
+ * only after compaction. Checks that data of moved blocks is intact and that
+ * blits done by another task at the same time are not disturbed. */
+static void vMainTask(__unused void *data) {
+  if (ChipMemInit(ZONESZ))
+    Panic("chipmem: cannot reserve zone!");
+
+  BitmapInit(&Src, 320, 64, 1, BM_NORMAL);
+  BitmapInit(&Dst, 320, 64, 1, BM_NORMAL);
+
+  uint16_t *src = Src.planes[0];
+  for (int j = 0; j < Src.bytesPerRow * Src.height / 2; j++)
+    src[j] = j * 0x9e37;
+
+  xTaskCreate(vBlitTask, "blit", configMINIMAL_STACK_SIZE, NULL,
+              TASK_PRIORITY, NULL);
+
+  for (int round = 0; round < NROUNDS; round++) {
+    for (int i = 0; i < NBLOCKS; i++) {
+      if (!(Block[i] = ChipMemAlloc(BlockSize(i), 0)))
+        Panic("chipmem: cannot allocate block %d!", i);
+      BlockFill(i);
+    }
+
+    /* The first block stays put, as the others are moved past it. */
+    (void)ChipMemLock(Block[0]);
+
+    for (int i = 2; i < NBLOCKS; i += 2) {
+      ChipMemFree(Block[i]);
+      Block[i] = NULL;
+    }
+
+    /* Free space past the last block is smaller than that. */
+    ChipMem_t *big = ChipMemAlloc(ChipMemAvail() - 512, 0);
+    if (big == NULL)
+      Panic("chipmem: compaction did not make space!");
+
+    ChipMemUnlock(Block[0]);
+
+    for (int i = 0; i < NBLOCKS; i++) {
+      if (Block[i]) {
+        BlockCheck(i);
+        ChipMemFree(Block[i]);
+      }
+    }
+    ChipMemFree(big);
+  }
+
+  Done = true;
+  vTaskDelay(1);
+  WaitBlitter();
+
+  uint16_t *dst = Dst.planes[0];
+  for (int j = 0; j < Dst.bytesPerRow * Dst.height / 2; j++)
+    if (dst[j] != src[j])
+      Panic("chipmem: blit damaged at word %d!", j);
+
+  Log("chipmem: %d rounds of compaction passed\n", NROUNDS);
+  vTaskDelete(NULL);
+}
+
+static void SystemClockTickHandler(__unused void *data) {
+  /* Increment the system timer value and possibly preempt. */
+  uint32_t ulSavedInterruptMask = portSET_INTERRUPT_MASK_FROM_ISR();
+  xNeedRescheduleTask = xTaskIncrementTick();
+  portCLEAR_INTERRUPT_MASK_FROM_ISR(ulSavedInterruptMask);
+}
+
+INTSERVER_DEFINE(SystemClockTick, 10, SystemClockTickHandler, NULL);
+
+int main(void) {
+  NOP(); /* Breakpoint for simulator. */
+
+  AddIntServer(VertBlankChain, SystemClockTick);
+  EnableDMA(DMAF_BLITTER);
+
+  xTaskCreate(vMainTask, "main", configMINIMAL_STACK_SIZE, NULL,
+              TASK_PRIORITY, NULL);
+
+  vTaskStartScheduler();
+
+  return 0;
+}
+
+void vApplicationIdleHook(void) {
+  MemIdle();
+  custom.color[0] = 0x00f;
+}
@@ -8,7 +8,7 @@
 #include <input.h>
 #include <display.h>
 #include <ioreq.h>
-#include <notify.h>
+#include <waitset.h>
 
 #define INPUT_TASK_PRIO 2
 
@@ -22,43 +22,59 @@ static const char *EventName[] = {
   [IE_KEYBOARD_DOWN] = "keyboard key down",
 };
 
-void vConsoleTask(void *data __unused) {
-  File_t *disp, *ms, *kbd;
+static void HandleKeyboard(File_t *disp, File_t *kbd) {
+  InputEvent_t ev;
 
-  FileOpen("display", O_WRONLY, &disp);
-  FileOpen("mouse", O_RDONLY | O_NONBLOCK, &ms);
-  FileOpen("keyboard", O_RDONLY | O_NONBLOCK, &kbd);
+  while (!FileRead(kbd, &ev, sizeof(ev), NULL)) {
+    char c = (ev.value >= 0x20 && ev.value < 0x7f) ? ev.value : ' ';
+    FilePrintf(disp, "%s: value = %x, char = '%c'\n", EventName[ev.kind],
+               (uint16_t)ev.value, c);
+  }
+}
+
+static void HandleMouse(File_t *disp, File_t *ms) {
+  static MousePos_t m = {.x = 0, .y = 0};
+  InputEvent_t ev;
 
-  (void)FileEvent(ms, EV_ADD, EVFILT_READ);
-  (void)FileEvent(kbd, EV_ADD, EVFILT_READ);
+  while (!FileRead(ms, &ev, sizeof(ev), NULL)) {
+    FilePrintf(disp, "%s: value = %d\n", EventName[ev.kind], ev.value);
 
-  while (NotifyWait(NB_EVENT, portMAX_DELAY)) {
-    InputEvent_t ev;
+    if (ev.kind == IE_MOUSE_DELTA_X) {
+      m.x += ev.value;
+      m.x = max(0, m.x);
+      m.x = min(m.x, 319);
+    }
 
-    while (!FileRead(kbd, &ev, sizeof(ev), NULL)) {
-      char c = (ev.value >= 0x20 && ev.value < 0x7f) ? ev.value : ' ';
-      FilePrintf(disp, "%s: value = %x, char = '%c'\n", EventName[ev.kind],
-                 (uint16_t)ev.value, c);
+    if (ev.kind == IE_MOUSE_DELTA_Y) {
+      m.y += ev.value;
+      m.y = max(0, m.y);
+      m.y = min(m.y, 255);
     }
 
-    while (!FileRead(ms, &ev, sizeof(ev), NULL)) {
-      static MousePos_t m = {.x = 0, .y = 0};
+    FileIoctl(disp, DIOCSETMS, &m);
+  }
+}
 
-      FilePrintf(disp, "%s: value = %d\n", EventName[ev.kind], ev.value);
+void vConsoleTask(void *data __unused) {
+  File_t *disp, *ms, *kbd;
+  WaitItem_t ready[2];
+  int n;
 
-      if (ev.kind == IE_MOUSE_DELTA_X) {
-        m.x += ev.value;
-        m.x = max(0, m.x);
-        m.x = min(m.x, 319);
-      }
+  FileOpen("display", O_WRONLY, &disp);
+  FileOpen("mouse", O_RDONLY | O_NONBLOCK, &ms);
+  FileOpen("keyboard", O_RDONLY | O_NONBLOCK, &kbd);
 
-      if (ev.kind == IE_MOUSE_DELTA_Y) {
-        m.y += ev.value;
-        m.y = max(0, m.y);
-        m.y = min(m.y, 255);
-      }
+  WaitSet_t *ws = WaitSetAlloc(2);
+  (void)WaitSetAdd(ws, kbd, POLLIN, 0);
+  (void)WaitSetAdd(ws, ms, POLLIN, 0);
 
-      FileIoctl(disp, DIOCSETMS, &m);
+  /* Only files that have some events queued up are read. */
+  while (!WaitSetWait(ws, ready, 2, portMAX_DELAY, &n)) {
+    for (int i = 0; i < n; i++) {
+      if (ready[i].file == kbd)
+        HandleKeyboard(disp, kbd);
+      else if (ready[i].file == ms)
+        HandleMouse(disp, ms);
     }
   }
 }
@@ -12,6 +12,7 @@
 #include <string.h>
 #include <interrupt.h>
 #include <tty.h>
+#include <memory.h>
 
 #define SHELL_TASK_PRIO 0
 #define BUFSIZE 256L
@@ -307,4 +308,5 @@ int main(void) {
 }
 
 void vApplicationIdleHook(void) {
+  MemIdle();
 }
@@ -1,25 +1,50 @@
 #include <FreeRTOS/FreeRTOS.h>
 #include <FreeRTOS/task.h>
-#include <FreeRTOS/queue.h>
 
+#include <buf.h>
+#include <devfile.h>
 #include <driver.h>
 #include <floppy.h>
+#include <ioreq.h>
+#include <memory.h>
+#include <msgport.h>
+#include <notify.h>
+#include <string.h>
 #include <sys/errno.h>
 
+#define DEBUG 0
+#include <debug.h>
+
 #include "filesys.h"
 
+/*
+ * Read-only filesystem laid out by tools/fsutil.py. Each file occupies
+ * a contiguous run of sectors, so a file offset translates directly into
+ * a disk offset and the only metadata is the directory.
+ *
+ * The filesystem task owns the directory cache and serves requests that
+ * access it. Reads do not touch the directory, so they are performed by the
+ * calling task and several readers may keep the floppy driver busy at once.
+ * The directory and reads shorter than a track go through the buffer cache,
+ * which keeps recently used tracks, hence small reads and rereads of the same
+ * data are served from memory. Longer reads are transferred by the floppy
+ * driver straight into the caller's buffer.
+ */
+
+#define DIR_OFFSET (2 * SECTOR_SIZE) /* directory follows the bootblock */
+#define FS_NMSGS 8                   /* maximum number of pending messages */
+
 typedef enum {
   FS_MOUNT,   /* mount filesystem */
   FS_UNMOUNT, /* unmount filesystem */
   FS_DIRENT,  /* fetch one directory entry */
   FS_OPEN,    /* open a file */
   FS_CLOSE,   /* close the file */
-  FS_READ     /* read some bytes from the file */
 } FsCmd_t;
 
 typedef struct FsFile {
   File_t f;
-  DirEntry_t *de;
+  const DirEntry_t *de;
 } FsFile_t;
 
 /* The type of message send to file system task. */
@@ -27,22 +52,16 @@ typedef struct FsMsg {
   FsCmd_t cmd; /* request type */
   union {      /* data specific to given request type */
     struct {
-    } mount;
-    struct {
-    } umount;
-    struct {
+      void **base_p;
     } dirent;
     struct {
+      const char *name;
     } open;
     struct {
+      FsFile_t *file;
     } close;
-    struct {
-    } read;
   } request;
-  struct {
-    long *replyp;      /* store result here before task wakeup */
-    TaskHandle_t task; /* notify this task when reponse is ready */
-  } response;
+  long result; /* filled in by the filesystem task before reply */
 } FsMsg_t;
 
 static int FsRead(FsFile_t *f, IoReq_t *io);
@@ -53,16 +72,202 @@ static FileOps_t FsOps = {.read = (FileRdWr_t)FsRead,
                           .seek = (FileSeek_t)FsSeek,
                           .close = (FileClose_t)FsClose};
 
+static MsgPort_t *FsPort;
+
+/* State below is owned by the filesystem task. */
+static File_t *Device;     /* floppy device, NULL if not mounted */
+static DevFile_t *Disk;    /* device file behind `Device` */
+static uint8_t *Directory; /* cached directory entries */
+static size_t DirSize;     /* size of directory entries in bytes */
+static int NOpened;        /* number of opened files */
+
+/* Copies data at disk `offset` into `io` buffers out of cached blocks. */
+static int DiskRead(off_t offset, IoReq_t *io) {
+  size_t bsize = Disk->blksize;
+
+  while (io->left > 0) {
+    Buf_t *bp;
+    int error = BufRead(Disk, offset / bsize, &bp);
+    if (error)
+      return error;
+    size_t boff = offset % bsize;
+    size_t n = min(IoReqSegLen(io), bsize - boff);
+    memcpy(io->rbuf, (uint8_t *)bp->data + boff, n);
+    BufRelease(bp);
+    IoReqAdvance(io, n);
+    offset += n;
+  }
+
+  return 0;
+}
+
+/* Checks that entries fill the directory exactly, each of them keeps the next
+ * one 2-byte aligned and has a name terminated within its record. Otherwise
+ * walking the directory could loop forever or run past its end. */
+static bool DirValid(const uint8_t *dir, size_t size) {
+  size_t off = 0;
+
+  while (off < size) {
+    const DirEntry_t *de = (const DirEntry_t *)(dir + off);
+    size_t namelen, i;
+
+    if (size - off < sizeof(DirEntry_t) + 1)
+      return false;
+    if (de->reclen < sizeof(DirEntry_t) + 1 || de->reclen > size - off ||
+        (de->reclen & 1))
+      return false;
+    namelen = de->reclen - sizeof(DirEntry_t);
+    for (i = 0; i < namelen && de->name[i]; i++)
+      continue;
+    if (i == namelen)
+      return false;
+
+    off += de->reclen;
+  }
+
+  return true;
+}
+
+static long FsDoMount(void) {
+  uint16_t dirsize;
+  IoReq_t io;
+
+  if (Device)
+    return false;
+
+  if (FileOpen("floppy", O_RDONLY, &Device)) {
+    Device = NULL;
+    return false;
+  }
+
+  Disk = Device->device;
+
+  /* The second read is served from the block that the first one brought. */
+  io = IOREQ_READ(0, &dirsize, sizeof(dirsize), 0);
+  if (DiskRead(DIR_OFFSET, &io))
+    goto fail;
+
+  /* Size comes from the disk, which may not hold our filesystem at all. */
+  if (dirsize == 0)
+    goto fail;
+
+  if (!(Directory = MemAlloc(dirsize, MF_TRY | MF_TAG(MT_KERNEL))))
+    goto fail;
+
+  io = IOREQ_READ(0, Directory, dirsize, 0);
+  if (DiskRead(DIR_OFFSET + sizeof(dirsize), &io))
+    goto fail;
+
+  if (!DirValid(Directory, dirsize))
+    goto fail;
+
+  DirSize = dirsize;
+  DLOG("filesys: mounted directory of %d bytes\n", DirSize);
+  return true;
+
+fail:
+  MemFree(Directory);
+  Directory = NULL;
+  FileClose(Device);
+  Device = NULL;
+  Disk = NULL;
+  return false;
+}
+
+static long FsDoUnMount(void) {
+  if (NOpened > 0)
+    return NOpened;
+
+  if (Device) {
+    MemFree(Directory);
+    Directory = NULL;
+    DirSize = 0;
+    /* The disk may be replaced once it's unmounted. */
+    BufFlush(Disk);
+    FileClose(Device);
+    Device = NULL;
+    Disk = NULL;
+  }
+  return 0;
+}
+
+/* Returns entry that follows `de` or the first one if `de` is NULL. */
+static const DirEntry_t *FsNextEntry(const DirEntry_t *de) {
+  const uint8_t *ptr = de ? (const uint8_t *)de + de->reclen : Directory;
+  if (ptr == NULL || ptr >= Directory + DirSize)
+    return NULL;
+  return (const DirEntry_t *)ptr;
+}
+
+static long FsDoDirent(void **base_p) {
+  const DirEntry_t *de = FsNextEntry(*base_p);
+  *base_p = (void *)de;
+  return (long)de;
+}
+
+static long FsDoOpen(const char *name) {
+  const DirEntry_t *de;
+  FsFile_t *ff;
+
+  for (de = FsNextEntry(NULL); de; de = FsNextEntry(de))
+    if (!strcmp(de->name, name))
+      break;
+
+  if (de == NULL)
+    return (long)NULL;
+
+  if (!(ff = MemAlloc(sizeof(FsFile_t), MF_ZERO | MF_TAG(MT_KERNEL))))
+    return (long)NULL;
+
+  ff->f.ops = &FsOps;
+  ff->f.usecount = 1;
+  ff->f.type = FT_INODE;
+  ff->f.flags = F_READ;
+  ff->de = de;
+  NOpened++;
+  return (long)ff;
+}
+
+static long FsDoClose(FsFile_t *ff) {
+  MemFree(ff);
+  NOpened--;
+  return 0;
+}
+
+static long FsHandleMsg(FsMsg_t *msg) {
+  switch (msg->cmd) {
+    case FS_MOUNT:
+      return FsDoMount();
+    case FS_UNMOUNT:
+      return FsDoUnMount();
+    case FS_DIRENT:
+      return FsDoDirent(msg->request.dirent.base_p);
+    case FS_OPEN:
+      return FsDoOpen(msg->request.open.name);
+    case FS_CLOSE:
+      return FsDoClose(msg->request.close.file);
+  }
+  return 0;
+}
+
 static void vFileSysTask(__unused void *data) {
   for (;;) {
+    FsMsg_t *msg;
+
+    (void)NotifyWait(NB_MSGPORT, portMAX_DELAY);
+
+    /* Floppy requests consume NB_MSGPORT as well, so check the port until it
+     * is empty. */
+    while ((msg = GetMsgData(FsPort))) {
+      msg->result = FsHandleMsg(msg);
+      ReplyMsg(FsPort);
+    }
   }
 }
 
 static long FsSendMsg(FsMsg_t *msg) {
-  /* TODO: fill in missing 'msg' fields, send it to filesystem task and wait for
-   * the response. */
-  (void)msg;
-  return 0;
+  DoMsg(FsPort, &MSG(msg));
+  return msg->result;
 }
 
 bool FsMount(void) {
@@ -70,51 +275,84 @@ bool FsMount(void) {
   return FsSendMsg(&msg);
 }
 
-/* Remember to free memory used up by a directory! */
 int FsUnMount(void) {
   FsMsg_t msg = {.cmd = FS_UNMOUNT};
   return FsSendMsg(&msg);
 }
 
 const DirEntry_t *FsListDir(void **base_p) {
-  FsMsg_t msg = {.cmd = FS_DIRENT};
-  FsSendMsg(&msg);
-  return *base_p;
+  FsMsg_t msg = {.cmd = FS_DIRENT, .request.dirent.base_p = base_p};
+  return (const DirEntry_t *)FsSendMsg(&msg);
 }
 
 File_t *FsOpen(const char *name) {
-  FsMsg_t msg = {.cmd = FS_OPEN};
-  (void)name;
+  FsMsg_t msg = {.cmd = FS_OPEN, .request.open.name = name};
   return (File_t *)FsSendMsg(&msg);
 }
 
 static int FsClose(FsFile_t *ff) {
-  FsMsg_t msg = {.cmd = FS_CLOSE};
-  (void)ff;
+  FsMsg_t msg = {.cmd = FS_CLOSE, .request.close.file = ff};
   return FsSendMsg(&msg);
 }
 
+/* Disk offset of byte at `pos` within file described by `de`. */
+static inline off_t FsDiskOffset(const DirEntry_t *de, off_t pos) {
+  return de->start * SECTOR_SIZE + pos;
+}
+
 static int FsRead(FsFile_t *ff, IoReq_t *io) {
-  FsMsg_t msg = {.cmd = FS_READ};
-  (void)ff, (void)io;
-  return FsSendMsg(&msg);
+  const DirEntry_t *de = ff->de;
+  off_t pos = ff->f.offset;
+
+  if (pos >= (off_t)de->size)
+    return 0;
+
+  if (io->left > de->size - pos)
+    io->left = de->size - pos;
+
+  size_t n = io->left;
+  int error;
+
+  /* The rest of the file is contiguous on disk, so a read that spans a track
+   * or more is done with a single floppy request. */
+  if (n >= TRACK_SIZE) {
+    io->offset = FsDiskOffset(de, pos);
+    error = Device->ops->read(Device, io);
+  } else {
+    error = DiskRead(FsDiskOffset(de, pos), io);
+  }
+
+  ff->f.offset = pos + n - io->left;
+  return error;
 }
 
 /* Does not involve direct interaction with the filesystem. */
 static int FsSeek(FsFile_t *ff, long offset, int whence) {
-  (void)ff, (void)offset, (void)whence;
-  return ENOSYS;
+  if (whence == SEEK_CUR) {
+    offset += ff->f.offset;
+  } else if (whence == SEEK_END) {
+    offset += ff->de->size;
+  } else if (whence != SEEK_SET) {
+    return EINVAL;
+  }
+
+  if (offset < 0) {
+    offset = 0;
+  } else if (offset > (long)ff->de->size) {
+    offset = ff->de->size;
+  }
+
+  ff->f.offset = offset;
+  return 0;
 }
 
 static TaskHandle_t filesysHandle;
 
-#define FLOPPY_TASK_PRIO 3
 #define FILESYS_TASK_PRIO 2
 
 void FsInit(void) {
-  (void)FsOps;
-
   DeviceAttach(&Floppy);
   xTaskCreate(vFileSysTask, "filesys", configMINIMAL_STACK_SIZE, NULL,
               FILESYS_TASK_PRIO, &filesysHandle);
+  FsPort = MsgPortCreate(filesysHandle, FS_NMSGS);
 }
@@ -3,6 +3,7 @@
 
 #include <interrupt.h>
 #include <stdio.h>
+#include <memory.h>
 
 #include "filesys.h"
 
@@ -33,5 +34,6 @@ int main(void) {
 }
 
 void vApplicationIdleHook(void) {
+  MemIdle();
   custom.color[0] = 0;
 }
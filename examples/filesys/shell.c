@@ -148,6 +148,22 @@ static BaseType_t cmdReadFile(char *out, size_t len, const char *cmdline) {
   return left;
 }
 
+static BaseType_t cmdListDir(char *out, size_t len, const char *cmdline) {
+  static void *base = NULL;
+  (void)cmdline;
+
+  /* Listing ends with NULL, which also resets `base` for the next one. */
+  const DirEntry_t *de = FsListDir(&base);
+  if (de == NULL) {
+    *out = '\0';
+    return pdFALSE;
+  }
+
+  snprintf(out, len, "%-32s %6ld%s\n", de->name, (long)de->size,
+           de->type ? " (executable)" : "");
+  return pdTRUE;
+}
+
 static BaseType_t cmdDummy(char *buf, size_t len, const char *cmdline) {
   (void)buf;
   (void)len;
@@ -190,7 +206,7 @@ static const CLI_Command_Definition_t xListDirCmd = {
   "ls",
   "ls:\n"
   " List directory entries\n\n",
-  cmdDummy, 0};
+  cmdListDir, 0};
 
 #define MAX_INPUT_LENGTH 80
 #define MAX_OUTPUT_LENGTH 160
@@ -150,5 +150,6 @@ int main(void) {
 }
 
 void vApplicationIdleHook(void) {
+  MemIdle();
   custom.color[0] = 0;
 }
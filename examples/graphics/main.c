@@ -6,6 +6,7 @@
 #include <bitmap.h>
 #include <copper.h>
 #include <blitter.h>
+#include <memory.h>
 
 #include "data/simpsons-bg.c"
 #include "data/bart.c"
@@ -84,4 +85,5 @@ int main(void) {
 }
 
 void vApplicationIdleHook(void) {
+  MemIdle();
 }
@@ -4,6 +4,7 @@
 #include <cpu.h>
 #include <custom.h>
 #include <trap.h>
+#include <memory.h>
 
 extern int rand(void);
 
@@ -74,5 +75,6 @@ int main(void) {
 }
 
 void vApplicationIdleHook(void) {
+  MemIdle();
   custom.color[0] = 0x00f;
 }
@@ -0,0 +1,135 @@
+#include <FreeRTOS/FreeRTOS.h>
+#include <FreeRTOS/task.h>
+
+#include <custom.h>
+#include <interrupt.h>
+#include <debug.h>
+#include <driver.h>
+#include <devfile.h>
+#include <file.h>
+#include <mbuf.h>
+#include <memory.h>
+#include <msgport.h>
+#include <notify.h>
+#include <tty.h>
+
+#define BENCH_TASK_PRIORITY 1
+
+#define NBYTES 4096
+#define CALIB_TICKS 50
+
+#define CPU_CLOCK 7093790 /* PAL */
+#define CYCLES_PER_TICK (CPU_CLOCK / configTICK_RATE_HZ)
+
+/* Data has no line feeds, so the terminal passes chain buffers on as is. */
+static const char Text[] = "The quick brown fox jumps over the lazy dog. ";
+
+static char Buf[MCLBYTES];
+static volatile uint32_t IdleCount;
+
+static void vProducerTask(MsgPort_t *mp) {
+  Mbuf_t *m = MbufCopyIn(Buf, sizeof(Buf));
+  if (m == NULL || MbufPut(mp, m))
+    Panic("mbuf: cannot send chain!");
+  vTaskDelete(NULL);
+}
+
+/* Number of idle hook calls per tick when the system does nothing. */
+static uint32_t IdleRate(void) {
+  vTaskDelay(1);
+  uint32_t idle = IdleCount;
+  vTaskDelay(CALIB_TICKS);
+  return (IdleCount - idle) / CALIB_TICKS;
+}
+
+/* Converts idle hook calls missing in `ticks` into processor cycles spent
+ * per byte. */
+static void Report(const char *name, TickType_t ticks, uint32_t idle,
+                   uint32_t rate) {
+  uint32_t busy = ticks * rate > idle ? ticks * rate - idle : 0;
+  uint32_t cycles = busy / rate * CYCLES_PER_TICK +
+                    busy % rate * CYCLES_PER_TICK / rate;
+  Log("%s: %d bytes in %d ticks, %d cycles/byte\n", name, NBYTES, ticks,
+      cycles / NBYTES);
+}
+
+/* Compares processor time spent on sending data through the terminal to the
+ * serial port when the terminal copies data out of a buffer with the case
+ * when it takes references to clusters of a chain. */
+static void vBenchTask(__unused void *data) {
+  File_t *tty;
+  TickType_t start;
+  uint32_t idle;
+
+  for (size_t i = 0; i < sizeof(Buf); i++)
+    Buf[i] = Text[i % (sizeof(Text) - 1)];
+
+  if (FileOpen("tty", O_WRONLY, &tty))
+    Panic("mbuf: cannot open tty!");
+
+  /* The chain is handed over by another task without copying. */
+  MsgPort_t *mp = MsgPortCreate(xTaskGetCurrentTaskHandle(), 1);
+  xTaskCreate((TaskFunction_t)vProducerTask, "producer",
+              configMINIMAL_STACK_SIZE, mp, BENCH_TASK_PRIORITY, NULL);
+  Mbuf_t *m;
+  while (!(m = MbufGet(mp)))
+    (void)NotifyWait(NB_MSGPORT, portMAX_DELAY);
+  MsgPortDelete(mp);
+
+  uint32_t rate = IdleRate();
+  Log("idle: %d calls per tick\n", rate);
+
+  start = xTaskGetTickCount();
+  idle = IdleCount;
+  for (int i = 0; i < NBYTES / MCLBYTES; i++)
+    FileWrite(tty, Buf, sizeof(Buf), NULL);
+  Report("copy", xTaskGetTickCount() - start, IdleCount - idle, rate);
+
+  /* Let the device drain its queue before next round. */
+  vTaskDelay(CALIB_TICKS);
+
+  /* The chain stays ours, as the terminal holds references to its cluster
+   * only while the data is being sent. */
+  start = xTaskGetTickCount();
+  idle = IdleCount;
+  for (int i = 0; i < NBYTES / MCLBYTES; i++)
+    FileWriteChain(tty, m, NULL);
+  Report("chain", xTaskGetTickCount() - start, IdleCount - idle, rate);
+
+  MbufFreeChain(m);
+  FileClose(tty);
+  vTaskDelete(NULL);
+}
+
+static void SystemClockTickHandler(__unused void *data) {
+  /* Increment the system timer value and possibly preempt. */
+  uint32_t ulSavedInterruptMask = portSET_INTERRUPT_MASK_FROM_ISR();
+  xNeedRescheduleTask = xTaskIncrementTick();
+  portCLEAR_INTERRUPT_MASK_FROM_ISR(ulSavedInterruptMask);
+}
+
+INTSERVER_DEFINE(SystemClockTick, 10, SystemClockTickHandler, NULL);
+
+static xTaskHandle benchHandle;
+
+int main(void) {
+  NOP(); /* Breakpoint for simulator. */
+
+  AddIntServer(VertBlankChain, SystemClockTick);
+
+  DeviceAttach(&Serial);
+  AddTtyDevFile("tty", DevFileLookup("serial"));
+
+  xTaskCreate(vBenchTask, "bench", configMINIMAL_STACK_SIZE, NULL,
+              BENCH_TASK_PRIORITY, &benchHandle);
+
+  vTaskStartScheduler();
+
+  return 0;
+}
+
+/* Idle time is the measure of work done, so memory is not tidied up here. */
+void vApplicationIdleHook(void) {
+  IdleCount++;
+  custom.color[0] = 0x00f;
+}
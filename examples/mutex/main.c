@@ -0,0 +1,100 @@
+#include <FreeRTOS/FreeRTOS.h>
+#include <FreeRTOS/atomic.h>
+#include <FreeRTOS/semphr.h>
+#include <FreeRTOS/task.h>
+
+#include <custom.h>
+#include <interrupt.h>
+#include <debug.h>
+#include <atomic.h>
+#include <memory.h>
+#include <mutex.h>
+
+#define BENCH_TASK_PRIORITY 2
+
+#define NLOOPS 20000
+
+#define CPU_CLOCK 7093790 /* PAL */
+#define CYCLES_PER_TICK (CPU_CLOCK / configTICK_RATE_HZ)
+
+static SemaphoreHandle_t Semaphore;
+static Mutex_t Mutex;
+static volatile uint32_t Counter;
+
+/* Runs `body` NLOOPS times and returns the number of ticks it took. Compiler
+ * barrier prevents merging iterations. */
+#define BENCH(body)                                                            \
+  ({                                                                           \
+    TickType_t _start = xTaskGetTickCount();                                   \
+    for (int _i = 0; _i < NLOOPS; _i++) {                                      \
+      body;                                                                    \
+      __compiler_membar();                                                     \
+    }                                                                          \
+    xTaskGetTickCount() - _start;                                              \
+  })
+
+static void Report(const char *name, TickType_t ticks, TickType_t base) {
+  ticks = ticks > base ? ticks - base : 0;
+  Log("%-24s: %d cycles\n", name, ticks * CYCLES_PER_TICK / NLOOPS);
+}
+
+/* Compares uncontended lock & unlock of FreeRTOS mutex with the one based on
+ * TAS instruction, as well as atomic operations provided by FreeRTOS, which
+ * mask interrupts, with the ones that execute a single instruction. */
+static void vBenchTask(__unused void *data) {
+  Semaphore = xSemaphoreCreateMutex();
+  MutexInit(&Mutex);
+
+  TickType_t base = BENCH(Counter = 0);
+
+  Report("xSemaphoreTake/Give", BENCH({
+           xSemaphoreTake(Semaphore, portMAX_DELAY);
+           xSemaphoreGive(Semaphore);
+         }),
+         base);
+  Report("MutexLock/Unlock", BENCH({
+           MutexLock(&Mutex);
+           MutexUnlock(&Mutex);
+         }),
+         base);
+  Report("Atomic_Increment_u32", BENCH(Atomic_Increment_u32(&Counter)), base);
+  Report("AtomicInc", BENCH(AtomicInc(&Counter)), base);
+  Report("Atomic_Decrement_u32", BENCH(Atomic_Decrement_u32(&Counter)), base);
+  Report("AtomicDecAndTest", BENCH(AtomicDecAndTest(&Counter)), base);
+  Report("Atomic_CompareAndSwap_u32",
+         BENCH(Atomic_CompareAndSwap_u32(&Counter, 1, 0)), base);
+  Report("AtomicCompareAndSwap", BENCH(AtomicCompareAndSwap(&Counter, 1, 0)),
+         base);
+
+  vSemaphoreDelete(Semaphore);
+  vTaskDelete(NULL);
+}
+
+static void SystemClockTickHandler(__unused void *data) {
+  /* Increment the system timer value and possibly preempt. */
+  uint32_t ulSavedInterruptMask = portSET_INTERRUPT_MASK_FROM_ISR();
+  xNeedRescheduleTask = xTaskIncrementTick();
+  portCLEAR_INTERRUPT_MASK_FROM_ISR(ulSavedInterruptMask);
+}
+
+INTSERVER_DEFINE(SystemClockTick, 10, SystemClockTickHandler, NULL);
+
+static xTaskHandle benchHandle;
+
+int main(void) {
+  NOP(); /* Breakpoint for simulator. */
+
+  AddIntServer(VertBlankChain, SystemClockTick);
+
+  xTaskCreate(vBenchTask, "bench", configMINIMAL_STACK_SIZE, NULL,
+              BENCH_TASK_PRIORITY, &benchHandle);
+
+  vTaskStartScheduler();
+
+  return 0;
+}
+
+void vApplicationIdleHook(void) {
+  MemIdle();
+  custom.color[0] = 0x00f;
+}
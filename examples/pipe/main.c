@@ -0,0 +1,148 @@
+#include <FreeRTOS/FreeRTOS.h>
+#include <FreeRTOS/task.h>
+
+#include <custom.h>
+#include <interrupt.h>
+#include <debug.h>
+#include <file.h>
+#include <memory.h>
+#include <pipe.h>
+#include <waitset.h>
+
+#define BENCH_TASK_PRIORITY 2
+
+#define NBYTES (1024 * 1024)
+#define BUFSZ 512
+
+static const char Text[] = "The quick brown fox jumps over the lazy dog.\n";
+
+static char CatBuf[BUFSZ];
+static char WcBuf[BUFSZ];
+
+/* Behaves like `cat` with standard output redirected to the pipe. */
+static void vCatTask(File_t *wr) {
+  for (int i = 0; i < NBYTES / BUFSZ; i++)
+    FileWrite(wr, CatBuf, BUFSZ, NULL);
+  FileClose(wr);
+  vTaskDelete(NULL);
+}
+
+/* Behaves like `wc` with standard input redirected from the pipe. If `wc` runs
+ * at higher priority, then it always waits for data when `cat` writes, so
+ * data is copied directly between their buffers. Otherwise `cat` fills up
+ * pipe buffer first and `wc` drains it. */
+static void BenchPipe(UBaseType_t catPriority) {
+  File_t *rd, *wr;
+  int lines = 0, words = 0, chars = 0;
+  bool inword = false;
+  long n;
+
+  if (PipeAlloc(&rd, &wr))
+    Panic("pipe: cannot allocate!");
+
+  TickType_t start = xTaskGetTickCount();
+
+  xTaskCreate((TaskFunction_t)vCatTask, "cat", configMINIMAL_STACK_SIZE, wr,
+              catPriority, NULL);
+
+  while (!FileRead(rd, WcBuf, BUFSZ, &n) && n > 0) {
+    for (int i = 0; i < n; i++) {
+      char c = WcBuf[i];
+      if (c == '\n')
+        lines++;
+      if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+        inword = false;
+      } else if (!inword) {
+        words++;
+        inword = true;
+      }
+    }
+    chars += n;
+  }
+
+  TickType_t ticks = max(xTaskGetTickCount() - start, 1U);
+
+  FileClose(rd);
+
+  Log("cat | wc (%s): %d %d %d in %d ticks, %d KiB/s\n",
+      catPriority < BENCH_TASK_PRIORITY ? "direct" : "buffered", lines, words,
+      chars, ticks, (chars / 1024) * configTICK_RATE_HZ / ticks);
+}
+
+/* Two pipes with data pending at the same time must be reported once each.
+ * When only one slot is given, the other pipe must be reported next time. */
+static void CheckWaitSet(void) {
+  File_t *rd[2], *wr[2];
+  WaitItem_t ready[2];
+  int count;
+
+  WaitSet_t *ws = WaitSetAlloc(2);
+  if (ws == NULL)
+    Panic("pipe: cannot allocate wait set!");
+
+  for (int i = 0; i < 2; i++) {
+    if (PipeAlloc(&rd[i], &wr[i]))
+      Panic("pipe: cannot allocate!");
+    FileWrite(wr[i], Text, 1, NULL);
+    WaitSetAdd(ws, rd[i], POLLIN, i);
+  }
+
+  WaitSetWait(ws, ready, 2, 0, &count);
+  if (count != 2 || ready[0].udata == ready[1].udata)
+    Panic("pipe: wait set reported %d files!", count);
+
+  WaitSetWait(ws, ready, 1, 0, &count);
+  intptr_t first = ready[0].udata;
+  WaitSetWait(ws, ready, 1, 0, &count);
+  if (count != 1 || ready[0].udata == first)
+    Panic("pipe: wait set starves a file!");
+
+  WaitSetFree(ws);
+  for (int i = 0; i < 2; i++) {
+    FileClose(rd[i]);
+    FileClose(wr[i]);
+  }
+
+  Log("pipe: wait set reports all ready files\n");
+}
+
+static void vBenchTask(__unused void *data) {
+  CheckWaitSet();
+
+  for (int i = 0; i < BUFSZ; i++)
+    CatBuf[i] = Text[i % (sizeof(Text) - 1)];
+
+  BenchPipe(BENCH_TASK_PRIORITY - 1);
+  BenchPipe(BENCH_TASK_PRIORITY + 1);
+
+  vTaskDelete(NULL);
+}
+
+static void SystemClockTickHandler(__unused void *data) {
+  /* Increment the system timer value and possibly preempt. */
+  uint32_t ulSavedInterruptMask = portSET_INTERRUPT_MASK_FROM_ISR();
+  xNeedRescheduleTask = xTaskIncrementTick();
+  portCLEAR_INTERRUPT_MASK_FROM_ISR(ulSavedInterruptMask);
+}
+
+INTSERVER_DEFINE(SystemClockTick, 10, SystemClockTickHandler, NULL);
+
+static xTaskHandle benchHandle;
+
+int main(void) {
+  NOP(); /* Breakpoint for simulator. */
+
+  AddIntServer(VertBlankChain, SystemClockTick);
+
+  xTaskCreate(vBenchTask, "bench", configMINIMAL_STACK_SIZE, NULL,
+              BENCH_TASK_PRIORITY, &benchHandle);
+
+  vTaskStartScheduler();
+
+  return 0;
+}
+
+void vApplicationIdleHook(void) {
+  MemIdle();
+  custom.color[0] = 0x00f;
+}
@@ -58,7 +58,58 @@ static void RandRealloc(void) {
   Slot[n] = q;
 }
 
+#define NBUFS 16
+#define NTEMPS 32
+#define NROUNDS 4000
+
+/* Realloc-heavy workload: buffers grow in small steps, like line editors or
+ * directory caches do, while short-lived blocks come and go in between. */
+static void BenchRealloc(void) {
+  static void *Buf[NBUFS], *Temp[NTEMPS];
+  static int BufSz[NBUFS];
+  MemReallocStats_t before, after;
+
+  MemGetReallocStats(&before);
+  TickType_t start = xTaskGetTickCount();
+
+  for (short i = 0; i < NROUNDS; i++) {
+    int n = rand() % NBUFS;
+    if (BufSz[n] >= MAXBLKSZ) {
+      MemFree(Buf[n]);
+      Buf[n] = NULL;
+      BufSz[n] = 0;
+    }
+    BufSz[n] += 1 + rand() % 64;
+    Buf[n] = MemRealloc(Buf[n], BufSz[n]);
+
+    int t = rand() % NTEMPS;
+    if (Temp[t]) {
+      MemFree(Temp[t]);
+      Temp[t] = NULL;
+    } else {
+      Temp[t] = MemAlloc(1 + rand() % 256, 0);
+    }
+  }
+
+  TickType_t ticks = xTaskGetTickCount() - start;
+  MemGetReallocStats(&after);
+  size_t largest = MemAvail(MF_LARGEST);
+
+  for (short i = 0; i < NBUFS; i++)
+    MemFree(Buf[i]);
+  for (short i = 0; i < NTEMPS; i++)
+    MemFree(Temp[i]);
+  MemCheck(0);
+
+  Log("realloc: %d ticks, %d in place, %d slid down, %d moved, "
+      "largest free block: %d\n",
+      ticks, after.inplace - before.inplace, after.slid - before.slid,
+      after.moved - before.moved, largest);
+}
+
 static void vTestHeapTask(__unused void *data) {
+  BenchRealloc();
+
   for (short i = 0; i < NSLOTS * 3 / 4; i++)
     RandMalloc();
   MemCheck(0);
@@ -121,5 +172,6 @@ int main(void) {
 }
 
 void vApplicationIdleHook(void) {
+  MemIdle();
   custom.color[0] = 0x00f;
 }
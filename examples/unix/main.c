@@ -9,6 +9,7 @@
 #include <proc.h>
 #include <debug.h>
 #include <tty.h>
+#include <memory.h>
 
 static File_t *FloppyOpen(const char *path) {
   (void)path;
@@ -52,5 +53,6 @@ int main(void) {
 }
 
 void vApplicationIdleHook(void) {
+  MemIdle();
   custom.color[0] = 0x00f;
 }
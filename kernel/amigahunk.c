@@ -1,5 +1,4 @@
 #include <amigahunk.h>
-#include <strings.h>
 #include <stdlib.h>
 #include <memory.h>
 
@@ -40,7 +39,8 @@ static bool AllocHunks(File_t *fh, Hunk_t **hunkArray, short hunkCount) {
     uint32_t n = ReadLong(fh);
 
     Hunk_t *hunk = MemAlloc(sizeof(Hunk_t) + n * sizeof(int),
-                            (n & HUNKF_CHIP) ? MF_CHIP : 0);
+                            ((n & HUNKF_CHIP) ? MF_CHIP : 0) | MF_ZERO |
+                              MF_TAG(MT_PROC));
     *hunkArray++ = hunk;
 
     if (!hunk)
@@ -48,7 +48,6 @@ static bool AllocHunks(File_t *fh, Hunk_t **hunkArray, short hunkCount) {
 
     hunk->size = n * sizeof(int);
     hunk->next = NULL;
-    bzero(hunk->data, n * sizeof(int));
 
     if (prev)
       prev->next = hunk;
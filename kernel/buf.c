@@ -0,0 +1,259 @@
+#include <FreeRTOS/FreeRTOS.h>
+
+#include <buf.h>
+#include <devfile.h>
+#include <memory.h>
+#include <mempool.h>
+#include <sys/errno.h>
+
+#define DEBUG 0
+#include <debug.h>
+
+#define NBUF 8          /* number of buffers kept in the cache */
+#define BUFHASH_SIZE 16 /* must be a power of two */
+
+typedef TAILQ_HEAD(, Buf) BufList_t;
+
+MEMPOOL_DEFINE(BufPool, sizeof(Buf_t), NBUF,
+               MF_ZERO | MF_TRY | MF_TAG(MT_KERNEL));
+
+static size_t BufShrink(void *data, MemFlags_t flags, MemPressure_t level,
+                        size_t size);
+
+MEMSHRINKER_DEFINE(BufShrinker, 0, BufShrink, NULL);
+
+/* Protects hash chains, LRU list and reference counters. It's never held
+ * while a block is transferred, as that would stall all cache lookups. */
+static Mutex_t BufLock;
+/* Hash chains are initialized on first use. */
+static BufList_t BufHash[BUFHASH_SIZE];
+static BufList_t BufLRU = TAILQ_HEAD_INITIALIZER(BufLRU);
+/* Number of buffers allocated. It exceeds NBUF only if all buffers were held
+ * at the time a block was requested. */
+static int NBufs;
+static bool BufShrinkerAdded;
+
+static BufList_t *BufChainOf(DevFile_t *dev, uint32_t blkno) {
+  uintptr_t h = (uintptr_t)dev ^ blkno;
+  BufList_t *chain = &BufHash[((h >> 4) ^ h) & (BUFHASH_SIZE - 1)];
+  if (chain->tqh_last == NULL)
+    TAILQ_INIT(chain);
+  return chain;
+}
+
+static int BufStrategy(Buf_t *bp, BufFlags_t op) {
+  bp->flags = (bp->flags & ~B_WRITE) | op;
+  return bp->dev->ops->strategy(bp);
+}
+
+/* Dissociates clean buffer from its block. */
+static void BufUnhash(Buf_t *bp) {
+  Assert(!(bp->flags & B_DIRTY));
+  if (bp->dev == NULL)
+    return;
+  TAILQ_REMOVE(BufChainOf(bp->dev, bp->blkno), bp, hash);
+  bp->dev = NULL;
+  bp->flags = 0;
+}
+
+/* Releases memory of an unreferenced buffer that is not on LRU list. */
+static size_t BufDestroy(Buf_t *bp) {
+  size_t size = bp->size;
+  BufUnhash(bp);
+  MemFree(bp->data);
+  MemPoolFree(BufPool, bp);
+  NBufs--;
+  return size;
+}
+
+/* Writes out a dirty buffer taken from LRU list. `BufLock` is dropped for the
+ * time of the transfer. Meanwhile the buffer stays in the cache, so tasks
+ * looking for the block wait for the buffer lock. The buffer goes back to the
+ * head of LRU list, as it's the first one to be reused. Must be called with
+ * `BufLock` held. */
+static void BufClean(Buf_t *bp) {
+  TAILQ_REMOVE(&BufLRU, bp, lru);
+  bp->refcnt++;
+  MutexUnlock(&BufLock);
+
+  MutexLock(&bp->lock);
+  if ((bp->flags & B_DIRTY) && BufStrategy(bp, B_WRITE))
+    Log("buf: lost delayed write of block %d!\n", bp->blkno);
+  bp->flags &= ~B_DIRTY;
+  MutexUnlock(&bp->lock);
+
+  MutexLock(&BufLock);
+  if (--bp->refcnt == 0)
+    TAILQ_INSERT_HEAD(&BufLRU, bp, lru);
+}
+
+/* Returns a referenced buffer assigned to the block. Unless the block is in
+ * the cache the buffer is either the least recently used one or a new one.
+ * The cache does not grow under memory pressure. Returns NULL if there's no
+ * memory. */
+static Buf_t *BufGet(DevFile_t *dev, uint32_t blkno) {
+  BufList_t *chain = BufChainOf(dev, blkno);
+  Buf_t *bp;
+
+  MutexLock(&BufLock);
+
+  if (!BufShrinkerAdded) {
+    AddMemShrinker(BufShrinker);
+    BufShrinkerAdded = true;
+  }
+
+  /* The lock may be dropped to clean a buffer. The block could have been
+   * brought into the cache by another task in the meantime, so look it up
+   * again afterwards. */
+  for (;;) {
+    TAILQ_FOREACH(bp, chain, hash) {
+      if (bp->dev == dev && bp->blkno == blkno) {
+        if (bp->refcnt++ == 0)
+          TAILQ_REMOVE(&BufLRU, bp, lru);
+        goto leave;
+      }
+    }
+
+    if ((NBufs < NBUF && !MemPressure(MF_ANY_PREFER_FAST)) ||
+        !(bp = TAILQ_FIRST(&BufLRU)))
+      break;
+
+    if (!(bp->flags & B_DIRTY)) {
+      /* Nobody refers to the buffer, so it can be taken over. */
+      TAILQ_REMOVE(&BufLRU, bp, lru);
+      BufUnhash(bp);
+      goto assign;
+    }
+
+    BufClean(bp);
+  }
+
+  if (!(bp = MemPoolAlloc(BufPool)))
+    goto leave;
+  NBufs++;
+
+assign:
+  if (bp->size != dev->blksize) {
+    MemFree(bp->data);
+    bp->size = 0;
+    bp->data = MemAlloc(dev->blksize, MF_TRY | MF_TAG(MT_KERNEL));
+    if (bp->data == NULL) {
+      BufDestroy(bp);
+      bp = NULL;
+      goto leave;
+    }
+    bp->size = dev->blksize;
+  }
+
+  bp->dev = dev;
+  bp->blkno = blkno;
+  bp->refcnt = 1;
+  TAILQ_INSERT_HEAD(chain, bp, hash);
+
+leave:
+  MutexUnlock(&BufLock);
+  return bp;
+}
+
+int BufRead(DevFile_t *dev, uint32_t blkno, Buf_t **bpp) {
+  Buf_t *bp;
+  int error;
+
+  Assert(dev->blksize > 0);
+
+  if (!(bp = BufGet(dev, blkno)))
+    return ENOMEM;
+
+  /* Another task may be filling the buffer, wait until it's done. */
+  MutexLock(&bp->lock);
+
+  if (!(bp->flags & B_VALID)) {
+    DLOG("buf: read block %d of '%s'\n", blkno, dev->name);
+    if ((error = BufStrategy(bp, 0))) {
+      BufRelease(bp);
+      return error;
+    }
+    bp->flags |= B_VALID;
+  }
+
+  *bpp = bp;
+  return 0;
+}
+
+int BufWrite(Buf_t *bp) {
+  int error = BufStrategy(bp, B_WRITE);
+  if (!error)
+    bp->flags &= ~B_DIRTY;
+  BufRelease(bp);
+  return error;
+}
+
+void BufDelayedWrite(Buf_t *bp) {
+  bp->flags |= B_DIRTY;
+  BufRelease(bp);
+}
+
+void BufRelease(Buf_t *bp) {
+  MutexUnlock(&bp->lock);
+
+  MutexLock(&BufLock);
+  if (--bp->refcnt == 0) {
+    /* Shrink the cache back to its regular size. Dirty buffers are kept
+     * until they get reused, as they must not be written out here. */
+    if (NBufs > NBUF && !(bp->flags & B_DIRTY))
+      BufDestroy(bp);
+    else
+      TAILQ_INSERT_TAIL(&BufLRU, bp, lru);
+  }
+  MutexUnlock(&BufLock);
+}
+
+void BufFlush(DevFile_t *dev) {
+  Buf_t *bp;
+
+  MutexLock(&BufLock);
+  for (;;) {
+    TAILQ_FOREACH(bp, &BufLRU, lru) {
+      if (bp->dev == dev)
+        break;
+    }
+    if (bp == NULL)
+      break;
+    if (bp->flags & B_DIRTY) {
+      /* LRU list may change while the lock is dropped, so start over. */
+      BufClean(bp);
+      continue;
+    }
+    BufUnhash(bp);
+    /* Buffer that holds no block is the best candidate for reuse. */
+    TAILQ_REMOVE(&BufLRU, bp, lru);
+    TAILQ_INSERT_HEAD(&BufLRU, bp, lru);
+  }
+  MutexUnlock(&BufLock);
+}
+
+/* Releases unreferenced clean buffers, starting with least recently used.
+ * Dirty ones would have to be written out, which cannot be done here. At low
+ * pressure only as many buffers are released as the allocation needs. */
+static size_t BufShrink(__unused void *data, __unused MemFlags_t flags,
+                        MemPressure_t level, size_t size) {
+  Buf_t *bp, *next;
+  size_t released = 0;
+
+  /* Shrinkers must not block. */
+  if (!MutexTryLock(&BufLock))
+    return 0;
+
+  TAILQ_FOREACH_SAFE(bp, &BufLRU, lru, next) {
+    if (level < MP_CRITICAL && released >= size)
+      break;
+    if (bp->flags & B_DIRTY)
+      continue;
+    TAILQ_REMOVE(&BufLRU, bp, lru);
+    released += BufDestroy(bp);
+  }
+
+  MutexUnlock(&BufLock);
+  DLOG("buf: shrinker released %d bytes\n", released);
+  return released;
+}
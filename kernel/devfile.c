@@ -1,7 +1,7 @@
 #include <FreeRTOS/FreeRTOS.h>
 #include <FreeRTOS/task.h>
-#include <FreeRTOS/atomic.h>
 
+#include <atomic.h>
 #include <file.h>
 #include <debug.h>
 #include <memory.h>
@@ -17,6 +17,9 @@ static int DevIoctl(File_t *, u_long cmd, void *);
 static int DevSeek(File_t *, long, int);
 static int DevClose(File_t *);
 static int DevEvent(File_t *, EvAction_t, EvFilter_t);
+static bool DevReady(File_t *, EvFilter_t);
+static int DevSubmit(File_t *, IoReq_t *);
+static void DevCancel(File_t *, IoReq_t *);
 
 static FileOps_t DevFileOps = {
   .read = DevRead,
@@ -25,6 +28,9 @@ static FileOps_t DevFileOps = {
   .seek = DevSeek,
   .close = DevClose,
   .event = DevEvent,
+  .ready = DevReady,
+  .submit = DevSubmit,
+  .cancel = DevCancel,
 };
 
 static TAILQ_HEAD(, DevFile) DevFileList = TAILQ_HEAD_INITIALIZER(DevFileList);
@@ -75,6 +81,20 @@ static int NoDevEvent(DevFile_t *dev __unused, EvAction_t act __unused,
   return ENOSYS;
 }
 
+static bool NoDevReady(DevFile_t *dev __unused, EvFilter_t filt __unused) {
+  return true;
+}
+
+/* Devices without I/O task of their own complete requests synchronously. */
+static int NoDevSubmit(DevFile_t *dev, IoReq_t *req) {
+  int error = req->write ? dev->ops->write(dev, req) : dev->ops->read(dev, req);
+  IoReqDone(req, error);
+  return 0;
+}
+
+static void NoDevCancel(DevFile_t *dev __unused, IoReq_t *req __unused) {
+}
+
 int AddDevFile(const char *name, DevFileOps_t *ops, DevFile_t **devp) {
   DevFile_t *dev;
   int error = 0;
@@ -86,7 +106,7 @@ int AddDevFile(const char *name, DevFileOps_t *ops, DevFile_t **devp) {
     goto leave;
   }
 
-  if (!(dev = MemAlloc(sizeof(DevFile_t), 0))) {
+  if (!(dev = MemAlloc(sizeof(DevFile_t), MF_TAG(MT_KERNEL)))) {
     error = ENOMEM;
     goto leave;
   }
@@ -105,6 +125,12 @@ int AddDevFile(const char *name, DevFileOps_t *ops, DevFile_t **devp) {
     ops->strategy = NoDevStrategy;
   if (ops->event == NULL)
     ops->event = NoDevEvent;
+  if (ops->ready == NULL)
+    ops->ready = NoDevReady;
+  if (ops->submit == NULL)
+    ops->submit = NoDevSubmit;
+  if (ops->cancel == NULL)
+    ops->cancel = NoDevCancel;
 
   TAILQ_INSERT_TAIL(&DevFileList, dev, node);
   dev->name = name;
@@ -139,7 +165,7 @@ int OpenDevFile(const char *name, File_t *f) {
   f->ops = &DevFileOps;
   f->type = FT_DEVICE;
   f->device = dev;
-  Atomic_Increment_u32(&dev->usecnt);
+  AtomicInc(&dev->usecnt);
 
 leave:
   xTaskResumeAll();
@@ -196,11 +222,28 @@ static int DevSeek(File_t *f, long offset, int whence) {
 
 static int DevClose(File_t *f) {
   DevFile_t *dev = f->device;
-  Atomic_Decrement_u32(&dev->usecnt);
-  return dev->ops->close(dev, f->flags);
+  AtomicDec(&dev->usecnt);
+  int error = dev->ops->close(dev, f->flags);
+  FileFree(f);
+  return error;
 }
 
 static int DevEvent(File_t *f, EvAction_t act, EvFilter_t filt) {
   DevFile_t *dev = f->device;
   return dev->ops->event(dev, act, filt);
 }
+
+static bool DevReady(File_t *f, EvFilter_t filt) {
+  DevFile_t *dev = f->device;
+  return dev->ops->ready(dev, filt);
+}
+
+static int DevSubmit(File_t *f, IoReq_t *req) {
+  DevFile_t *dev = f->device;
+  return dev->ops->submit(dev, req);
+}
+
+static void DevCancel(File_t *f, IoReq_t *req) {
+  DevFile_t *dev = f->device;
+  dev->ops->cancel(dev, req);
+}
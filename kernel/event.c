@@ -2,7 +2,7 @@
 #include <FreeRTOS/task.h>
 
 #include <event.h>
-#include <memory.h>
+#include <mempool.h>
 #include <notify.h>
 #include <sys/errno.h>
 
@@ -11,11 +11,21 @@ struct EventWaitNote {
   TaskHandle_t listener;
 };
 
+MEMPOOL_DEFINE(NotePool, sizeof(EventWaitNote_t), 8,
+               MF_ZERO | MF_TAG(MT_KERNEL));
+
 void EventNotifyFromISR(EventWaitList_t *wl) {
   EventWaitNote_t *wn;
   TAILQ_FOREACH (wn, wl, link) { NotifySendFromISR(wn->listener, NB_EVENT); }
 }
 
+void EventNotify(EventWaitList_t *wl) {
+  EventWaitNote_t *wn;
+  taskENTER_CRITICAL();
+  TAILQ_FOREACH (wn, wl, link) { NotifySend(wn->listener, NB_EVENT); }
+  taskEXIT_CRITICAL();
+}
+
 static EventWaitNote_t *LookupNote(EventWaitList_t *wl, TaskHandle_t listener) {
   EventWaitNote_t *wn = NULL;
   TAILQ_FOREACH (wn, wl, link) {
@@ -33,8 +43,8 @@ int EventMonitor(EventWaitList_t *wl, EvAction_t act) {
   EventWaitNote_t *note = NULL;
   int error = 0;
 
-  if (act == EV_ADD)
-    note = MemAlloc(sizeof(EventWaitNote_t), MF_ZERO);
+  if (act == EV_ADD && !(note = MemPoolAlloc(NotePool)))
+    return ENOMEM;
 
   taskENTER_CRITICAL();
   {
@@ -60,8 +70,7 @@ int EventMonitor(EventWaitList_t *wl, EvAction_t act) {
   }
   taskEXIT_CRITICAL();
 
-  if (note)
-    MemFree(note);
+  MemPoolFree(NotePool, note);
 
   return error;
 }
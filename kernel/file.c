@@ -1,21 +1,35 @@
 #include <FreeRTOS/FreeRTOS.h>
-#include <FreeRTOS/atomic.h>
+#include <FreeRTOS/task.h>
 
+#include <atomic.h>
 #include <event.h>
 #include <ioreq.h>
 #include <devfile.h>
-#include <memory.h>
+#include <mempool.h>
 #include <file.h>
 #include <sys/errno.h>
 
+MEMPOOL_DEFINE(FilePool, sizeof(File_t), 16, MF_ZERO | MF_TAG(MT_KERNEL));
+
+File_t *FileAlloc(void) {
+  File_t *f = MemPoolAlloc(FilePool);
+  if (f)
+    f->usecount = 1;
+  return f;
+}
+
+void FileFree(File_t *f) {
+  MemPoolFree(FilePool, f);
+}
+
 File_t *FileHold(File_t *f) {
-  uint32_t old = Atomic_Increment_u32(&f->usecount);
-  configASSERT(old > 0);
+  configASSERT(f->usecount > 0);
+  AtomicInc(&f->usecount);
   return f;
 }
 
 void FileDrop(File_t *f) {
-  Atomic_Decrement_u32(&f->usecount);
+  AtomicDec(&f->usecount);
 }
 
 int FileRead(File_t *f, void *buf, size_t nbyte, long *donep) {
@@ -38,6 +52,100 @@ int FileWrite(File_t *f, const void *buf, size_t nbyte, long *donep) {
   return error;
 }
 
+/* Performs vectored request `io` prepared by FileReadv or FileWritev. */
+static int FileDoVec(File_t *f, IoReq_t *io, const struct iovec *iov,
+                     int iovcnt, long *donep) {
+  if (iovcnt <= 0 || iovcnt > IOV_MAX)
+    return EINVAL;
+  IoReqSetVec(io, iov, iovcnt);
+  if ((ssize_t)io->left < 0)
+    return EINVAL;
+  size_t nbyte = io->left;
+  if (nbyte == 0) {
+    if (donep)
+      *donep = 0;
+    return 0;
+  }
+  int error = io->write ? f->ops->write(f, io) : f->ops->read(f, io);
+  if (donep)
+    *donep = nbyte - io->left;
+  return error;
+}
+
+int FileReadv(File_t *f, const struct iovec *iov, int iovcnt, long *donep) {
+  if (!(f->flags & F_READ))
+    return EINVAL;
+  IoReq_t io = IOREQ_READ(f->offset, NULL, 0, f->flags & F_IOFLAGS);
+  return FileDoVec(f, &io, iov, iovcnt, donep);
+}
+
+int FileWritev(File_t *f, const struct iovec *iov, int iovcnt, long *donep) {
+  if (!(f->flags & F_WRITE))
+    return EINVAL;
+  IoReq_t io = IOREQ_WRITE(f->offset, NULL, 0, f->flags & F_IOFLAGS);
+  return FileDoVec(f, &io, iov, iovcnt, donep);
+}
+
+int FileWriteChain(File_t *f, Mbuf_t *m, long *donep) {
+  if (!(f->flags & F_WRITE))
+    return EINVAL;
+  if (m == NULL) {
+    if (donep)
+      *donep = 0;
+    return 0;
+  }
+  IoReq_t io = IOREQ_WRITE(f->offset, NULL, 0, f->flags & F_IOFLAGS);
+  IoReqSetChain(&io, m);
+  size_t nbyte = io.left;
+  int error = nbyte ? f->ops->write(f, &io) : 0;
+  if (donep)
+    *donep = nbyte - io.left;
+  return error;
+}
+
+static int FileSubmit(File_t *f, IoReq_t *req) {
+  req->flags = f->flags & F_IOFLAGS;
+  req->async = 1;
+  req->error = 0;
+  req->cancel = false;
+  req->task = xTaskGetCurrentTaskHandle();
+  req->busy = true;
+
+  /* File cannot do I/O in the background, so complete the request now. */
+  if (f->ops->submit == NULL) {
+    int error = req->write ? f->ops->write(f, req) : f->ops->read(f, req);
+    IoReqDone(req, error);
+    return 0;
+  }
+
+  int error = f->ops->submit(f, req);
+  if (error)
+    req->busy = false;
+  return error;
+}
+
+int FileReadAsync(File_t *f, IoReq_t *req) {
+  if (!(f->flags & F_READ))
+    return EINVAL;
+  req->write = 0;
+  return FileSubmit(f, req);
+}
+
+int FileWriteAsync(File_t *f, IoReq_t *req) {
+  if (!(f->flags & F_WRITE))
+    return EINVAL;
+  req->write = 1;
+  return FileSubmit(f, req);
+}
+
+void FileCancel(File_t *f, IoReq_t *req) {
+  if (!req->busy)
+    return;
+  req->cancel = true;
+  if (f->ops->cancel)
+    f->ops->cancel(f, req);
+}
+
 int FileIoctl(File_t *f, u_long cmd, void *data) {
   return f->ops->ioctl(f, cmd, data);
 }
@@ -66,7 +174,7 @@ int FileOpen(const char *name, int oflags, File_t **fp) {
   flags |= (oflags & O_NONBLOCK) ? F_NONBLOCK : 0;
 
   File_t *f;
-  if (!(f = MemAlloc(sizeof(File_t), MF_ZERO)))
+  if (!(f = FileAlloc()))
     return ENOMEM;
 
   f->flags = flags;
@@ -78,12 +186,12 @@ int FileOpen(const char *name, int oflags, File_t **fp) {
   return 0;
 
 fail:
-  MemFree(f);
+  FileFree(f);
   return error;
 }
 
 int FileClose(File_t *f) {
-  if (Atomic_Decrement_u32(&f->usecount) > 1)
+  if (!AtomicDecAndTest(&f->usecount))
     return 0;
   return f->ops->close(f);
 }
@@ -91,3 +199,9 @@ int FileClose(File_t *f) {
 int FileEvent(File_t *f, EvAction_t act, EvFilter_t filt) {
   return f->ops->event(f, act, filt);
 }
+
+bool FileReady(File_t *f, EvFilter_t filt) {
+  if (f->ops->ready == NULL)
+    return true;
+  return f->ops->ready(f, filt);
+}
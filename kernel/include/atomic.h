@@ -0,0 +1,87 @@
+#pragma once
+
+#include <FreeRTOS/FreeRTOS.h>
+
+#include <sys/types.h>
+#include <cpu.h>
+
+/*
+ * Atomic operations for a single processor system.
+ *
+ * An instruction that reads, modifies and writes memory cannot be interrupted
+ * halfway through, so there's no need to mask interrupts around it. Condition
+ * codes are saved along with the context on interrupt, hence they can be
+ * examined with Scc instruction right after the memory has been modified.
+ *
+ * Amiga custom chips do not honour indivisible bus cycles of TAS and CAS, but
+ * that only matters to other bus masters, and they never touch kernel data.
+ */
+
+/* Increments `*p`. */
+static inline void AtomicInc(volatile uint32_t *p) {
+  asm volatile("\taddq.l\t#1,%0\n" : "+m"(*p) : : "cc");
+}
+
+/* Decrements `*p`. */
+static inline void AtomicDec(volatile uint32_t *p) {
+  asm volatile("\tsubq.l\t#1,%0\n" : "+m"(*p) : : "cc");
+}
+
+/* Decrements `*p` and returns true if it dropped to zero. */
+static inline bool AtomicDecAndTest(volatile uint32_t *p) {
+  uint8_t zero;
+  asm volatile("\tsubq.l\t#1,%0\n"
+               "\tseq\t%1\n"
+               : "+m"(*p), "=d"(zero)
+               :
+               : "cc");
+  return zero;
+}
+
+/* Sets the most significant bit of `*p` with TAS instruction. Returns true if
+ * `*p` was zero before, i.e. the caller is the one who has set it. */
+static inline bool AtomicTestAndSet(volatile uint8_t *p) {
+  uint8_t clear;
+  asm volatile("\ttas\t%0\n"
+               "\tseq\t%1\n"
+               : "+m"(*p), "=d"(clear)
+               :
+               : "cc");
+  return clear;
+}
+
+/* Clears the byte set with AtomicTestAndSet. Stores to memory issued before
+ * the call will not be moved past it. */
+static inline void AtomicClear(volatile uint8_t *p) {
+  __compiler_membar();
+  *p = 0;
+}
+
+/* Stores `new` into `*p` if it holds `old`. Returns true on success.
+ *
+ * 68020 and later use CAS instruction. Earlier processors lack one, so they
+ * mask interrupts for the duration of the comparison. CAS2 is not provided,
+ * since 68060 does not implement it in hardware. */
+static inline bool AtomicCompareAndSwap(volatile uint32_t *p, uint32_t old,
+                                        uint32_t new) {
+  uint8_t ok;
+
+  if (CpuModel & CF_68020) {
+    register volatile uint32_t *a0 asm("a0") = p;
+    register uint32_t d0 asm("d0") = old;
+    register uint32_t d1 asm("d1") = new;
+    /* cas.l d0,d1,(a0) is encoded by hand, as the code is built for 68010 */
+    asm volatile("\t.short\t0x0ed0,0x0040\n"
+                 "\tseq\t%1\n"
+                 : "+d"(d0), "=d"(ok)
+                 : "a"(a0), "d"(d1)
+                 : "cc", "memory");
+  } else {
+    uint32_t ipl = portSET_INTERRUPT_MASK_FROM_ISR();
+    if ((ok = (*p == old)))
+      *p = new;
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(ipl);
+  }
+
+  return ok;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <sys/types.h>
+#include <sys/queue.h>
+#include <mutex.h>
+
+typedef struct DevFile DevFile_t;
+
+typedef enum BufFlags {
+  B_VALID = 1, /* data holds block contents */
+  B_DIRTY = 2, /* data must be written out before the buffer is reused */
+  B_WRITE = 4, /* strategy is to write data to the device, otherwise read */
+} __packed BufFlags_t;
+
+/* Buffer holds a copy of a single device block. Buffers are kept in a cache
+ * indexed by device and block number, hence a block that is read again is
+ * served from memory. A buffer that nobody refers to is put on LRU list and
+ * reused in the least recently released order. Refer to BSD's buf(9). */
+typedef struct Buf {
+  TAILQ_ENTRY(Buf) hash; /* link on hash chain, if `dev` is set */
+  TAILQ_ENTRY(Buf) lru;  /* link on LRU list, if `refcnt` is zero */
+  DevFile_t *dev;        /* device the block belongs to */
+  uint32_t blkno;        /* block number in units of `dev->blksize` */
+  uint32_t refcnt;       /* number of tasks that hold the buffer */
+  Mutex_t lock;          /* held by the task that uses `data` */
+  BufFlags_t flags;
+  size_t size; /* size of `data` in bytes */
+  void *data;
+} Buf_t;
+
+/* Returns in `bpp` locked buffer with contents of block `blkno` of `dev`.
+ * The block is read with device's strategy only if it's not in the cache.
+ *
+ * Returns 0 on success, otherwise an errno code. */
+int BufRead(DevFile_t *dev, uint32_t blkno, Buf_t **bpp);
+
+/* Writes the buffer out immediately and releases it.
+ *
+ * Returns 0 on success, otherwise an errno code. */
+int BufWrite(Buf_t *bp);
+
+/* Marks the buffer dirty and releases it. The block is written out when the
+ * buffer gets reused, so many changes to it end up in a single write. */
+void BufDelayedWrite(Buf_t *bp);
+
+/* Releases the buffer acquired with BufRead. */
+void BufRelease(Buf_t *bp);
+
+/* Writes out dirty blocks of `dev` and drops them from the cache, e.g. before
+ * the medium gets replaced. Blocks still held are left intact. */
+void BufFlush(DevFile_t *dev);
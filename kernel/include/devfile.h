@@ -26,6 +26,9 @@ typedef int (*DevFileStrategy_t)(Buf_t *buf);
 typedef int (*DevFileIoctl_t)(DevFile_t *dev, u_long cmd, void *data,
                               FileFlags_t flags);
 typedef int (*DevFileEvent_t)(DevFile_t *dev, EvAction_t act, EvFilter_t filt);
+typedef bool (*DevFileReady_t)(DevFile_t *dev, EvFilter_t filt);
+typedef int (*DevFileSubmit_t)(DevFile_t *dev, IoReq_t *req);
+typedef void (*DevFileCancel_t)(DevFile_t *dev, IoReq_t *req);
 
 typedef enum DevFileType {
   DT_OTHER = 0,       /* other non-seekable device file */
@@ -47,6 +50,9 @@ struct DevFileOps {
   DevFileStrategy_t strategy; /* perform block I/O operation */
   DevFileIoctl_t ioctl;       /* read or modify device properties */
   DevFileEvent_t event; /* register handler for can-read or can-write events */
+  DevFileReady_t ready; /* check if can-read or can-write condition holds */
+  DevFileSubmit_t submit; /* queue asynchronous read or write request */
+  DevFileCancel_t cancel; /* abort asynchronous request if still possible */
 };
 
 /* DevFile node needed by filesystem implementation.
@@ -58,6 +64,7 @@ struct DevFile {
   void *data;      /* usually pointer to driver's private data */
   uint32_t usecnt; /* number of opened files referring to this device file */
   ssize_t size;    /* size in bytes, if `size` > 0 then device is seekable */
+  size_t blksize;  /* block size for `strategy`, 0 if it's not implemented */
 };
 
 /* Add device file to global list of available devices.
@@ -24,5 +24,8 @@ typedef TAILQ_HEAD(, EventWaitNote) EventWaitList_t;
 /* Called from ISR to wake up tasks waiting for given event. */
 void EventNotifyFromISR(EventWaitList_t *wl);
 
+/* Same as above, but intended to be called from a task. */
+void EventNotify(EventWaitList_t *wl);
+
 /* Add or remove calling task to the list of event listeners. */
 int EventMonitor(EventWaitList_t *wl, EvAction_t act);
@@ -8,8 +8,10 @@ typedef struct Inode Inode_t;
 typedef struct IoReq IoReq_t;
 typedef struct Pipe Pipe_t;
 typedef struct DevFile DevFile_t;
+typedef struct Mbuf Mbuf_t;
 typedef enum EvAction EvAction_t;
 typedef enum EvFilter EvFilter_t;
+struct iovec;
 
 typedef enum FileFlags {
   F_READ = BIT(0),     /* file can be read from */
@@ -23,7 +25,9 @@ typedef int (*FileRdWr_t)(File_t *f, IoReq_t *io);
 typedef int (*FileIoctl_t)(File_t *f, u_long cmd, void *data);
 typedef int (*FileSeek_t)(File_t *f, long offset, int whence);
 typedef int (*FileEvent_t)(File_t *f, EvAction_t act, EvFilter_t filt);
+typedef bool (*FileReady_t)(File_t *f, EvFilter_t filt);
 typedef int (*FileClose_t)(File_t *f);
+typedef void (*FileCancel_t)(File_t *f, IoReq_t *io);
 
 /* Operations available for a file object.
  * Simplified version of FreeBSD's fileops. */
@@ -34,6 +38,9 @@ typedef struct FileOps {
   FileSeek_t seek;   /* move cursor position (if applicable) */
   FileClose_t close; /* free up resources */
   FileEvent_t event; /* register handler for can-read or can-write events */
+  FileReady_t ready; /* check if can-read or can-write condition holds */
+  FileRdWr_t submit;   /* start asynchronous read or write (if applicable) */
+  FileCancel_t cancel; /* abort asynchronous request (if applicable) */
 } FileOps_t;
 
 typedef enum FileType {
@@ -57,6 +64,14 @@ typedef struct File {
   FileFlags_t flags;
 } File_t;
 
+/* Allocate a zeroed file object with reference counter set to one.
+ * Returns NULL if there's no memory left. */
+File_t *FileAlloc(void);
+
+/* Return file object to the pool. Called by `FileOps::close` implementations
+ * once the file is not referenced anymore. */
+void FileFree(File_t *f);
+
 /* Increase reference counter. */
 File_t *FileHold(File_t *f);
 
@@ -67,13 +82,37 @@ void FileDrop(File_t *f);
 int FileOpen(const char *name, int oflags, File_t **fp);
 int FileRead(File_t *f, void *buf, size_t nbyte, long *donep);
 int FileWrite(File_t *f, const void *buf, size_t nbyte, long *donep);
+int FileReadv(File_t *f, const struct iovec *iov, int iovcnt, long *donep);
+int FileWritev(File_t *f, const struct iovec *iov, int iovcnt, long *donep);
 int FileIoctl(File_t *f, u_long cmd, void *data);
 int FileSeek(File_t *f, long offset, int whence, long *newoffp);
 int FileClose(File_t *f);
 
+/* Writes out data held by chain `m`. The chain stays owned by the caller, but
+ * the file may keep references to its clusters instead of copying the data. */
+int FileWriteChain(File_t *f, Mbuf_t *m, long *donep);
+
+/* Start reading or writing `req` asynchronously and return immediately. The
+ * request must be initialized with IOREQ_READ or IOREQ_WRITE respectively.
+ * `req::offset` is used as is and the file cursor is not moved. Completion is
+ * reported as described in <ioreq.h>. Files that cannot perform I/O in the
+ * background complete the request before returning.
+ *
+ * Returns 0 if the request was submitted, otherwise an errno code. */
+int FileReadAsync(File_t *f, IoReq_t *req);
+int FileWriteAsync(File_t *f, IoReq_t *req);
+
+/* Asks to abort asynchronous request. The request is always completed, with
+ * ECANCELED if it was aborted before it finished. */
+void FileCancel(File_t *f, IoReq_t *req);
+
 void FilePrintf(File_t *f, const char *fmt, ...);
 void FileHexDump(File_t *f, void *ptr, size_t length);
 
 /* Registers calling task to be notified with NB_EVENT
  * when can-read or can-write event happens on the file. */
 int FileEvent(File_t *f, EvAction_t act, EvFilter_t filt);
+
+/* Returns true if reading from (EVFILT_READ) or writing to (EVFILT_WRITE) the
+ * file would not block. Files that do not report events are always ready. */
+bool FileReady(File_t *f, EvFilter_t filt);
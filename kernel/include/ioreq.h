@@ -1,31 +1,119 @@
 #pragma once
 
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <file.h>
+#include <mbuf.h>
+#include <msgport.h>
+
+typedef void (*IoReqDone_t)(IoReq_t *req);
 
 /* Tracks progress of I/O operation on a file object.
  *
- * `rbuf/wbuf` and `left` are updated during operation processing. */
+ * The buffer may be made of many segments (refer to IoReqSetVec) or buffers
+ * of a chain (refer to IoReqSetChain). `rbuf/wbuf` points into the current
+ * segment, which has `seglen` bytes left, and `left` counts bytes left in the
+ * whole request. Drivers must not transfer more than IoReqSegLen bytes at once
+ * and then call IoReqAdvance. If the request carries a chain, then `mbuf` is
+ * the buffer that holds the current segment, so that drivers may take
+ * a reference to the data instead of copying it.
+ *
+ * Asynchronous requests (refer to FileReadAsync and FileWriteAsync) must
+ * stay valid until they're completed. `busy` is cleared on completion, then
+ * `done` callback is called, or `task` receives NB_EVENT notification if no
+ * callback was provided. Callbacks run in the context of a task that
+ * completed the request and must not block. */
 typedef struct IoReq {
   off_t offset; /* valid only for seekable devices */
   union {
     char *rbuf;       /* valid if this is a read request */
     const char *wbuf; /* valid if this is a write request */
   };
-  size_t left;
-  FileFlags_t flags; /* currently only F_NONBLOCK is supported */
-  uint8_t write : 1; /* is it read or write request ? */
+  size_t left;             /* bytes left to transfer */
+  size_t seglen;           /* bytes left in current segment */
+  const struct iovec *iov; /* segments that follow the current one */
+  int iovcnt;              /* number of segments in `iov` */
+  Mbuf_t *mbuf;            /* buffer of the chain with current segment */
+  FileFlags_t flags;       /* currently only F_NONBLOCK is supported */
+  uint8_t write : 1;       /* is it read or write request ? */
+  uint8_t async : 1;       /* is the submitter going to wait for completion ? */
   int error;
+  /* Used by drivers that process requests in their own task. */
+  Msg_t msg;
+  /* Completion of asynchronous requests. */
+  volatile bool busy;   /* request is in progress */
+  volatile bool cancel; /* submitter asked to abort the request */
+  TaskHandle_t task;    /* task that submitted the request */
+  IoReqDone_t done;     /* called upon completion instead of notification */
 } IoReq_t;
 
 #define IOREQ_READ(_off, _buf, _len, _iof)                                     \
   (IoReq_t) {                                                                  \
-    .offset = (_off), .rbuf = (char *)(_buf), .left = (_len), .flags = (_iof), \
-    .write = 0, .error = 0                                                     \
+    .offset = (_off), .rbuf = (char *)(_buf), .left = (_len),                  \
+    .seglen = (_len), .flags = (_iof), .write = 0, .error = 0                  \
   }
 
 #define IOREQ_WRITE(_off, _buf, _len, _iof)                                    \
   (IoReq_t) {                                                                  \
     .offset = (_off), .wbuf = (const char *)(_buf), .left = (_len),            \
-    .flags = (_iof), .write = 1, .error = 0                                    \
+    .seglen = (_len), .flags = (_iof), .write = 1, .error = 0                  \
   }
+
+/* Makes `req` transfer data to or from `iovcnt` segments described by `iov`,
+ * which must stay valid until the request is finished. */
+void IoReqSetVec(IoReq_t *req, const struct iovec *iov, int iovcnt);
+
+/* Makes `req` transfer data to or from a single buffer. */
+static inline void IoReqSetBuf(IoReq_t *req, void *buf, size_t len) {
+  req->rbuf = buf;
+  req->left = req->seglen = len;
+  req->iovcnt = 0;
+  req->mbuf = NULL;
+}
+
+/* Makes `req` transfer data to or from buffers of chain `m`, which must stay
+ * valid until the request is finished. */
+void IoReqSetChain(IoReq_t *req, Mbuf_t *m);
+
+/* Returns the number of bytes that can be transferred contiguously. */
+static inline size_t IoReqSegLen(IoReq_t *req) {
+  return min(req->seglen, req->left);
+}
+
+/* Marks `n` bytes of current segment as transferred and moves on to the next
+ * non-empty segment if current one is exhausted. */
+static inline void IoReqAdvance(IoReq_t *req, size_t n) {
+  req->rbuf += n;
+  req->seglen -= n;
+  req->left -= n;
+  while (req->seglen == 0) {
+    if (req->iovcnt > 0) {
+      req->rbuf = req->iov->iov_base;
+      req->seglen = req->iov->iov_len;
+      req->iov++;
+      req->iovcnt--;
+    } else if (req->mbuf && req->mbuf->next) {
+      req->mbuf = req->mbuf->next;
+      req->rbuf = (char *)req->mbuf->data;
+      req->seglen = req->mbuf->len;
+    } else {
+      break;
+    }
+  }
+}
+
+/* Called by a driver when it has finished processing `req`. Sets `error` of
+ * the request and notifies the submitter of asynchronous request. */
+void IoReqDone(IoReq_t *req, int error);
+
+/* Waits for asynchronous request to complete. Consumes NB_EVENT
+ * notifications, so the caller must check other event sources afterwards.
+ * Returns `req::error`. */
+int IoReqWait(IoReq_t *req);
+
+/* Helpers for drivers that receive requests through a message port.
+ * IoReqSend queues `req` at `mp`. Asynchronous request is queued without
+ * blocking, otherwise the caller waits for IoReqReply. IoReqReply removes
+ * the request from `mp` and completes it with `error`. */
+int IoReqSend(MsgPort_t *mp, IoReq_t *req);
+void IoReqReply(MsgPort_t *mp, IoReq_t *req, int error);
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <sys/types.h>
+#include <msgport.h>
+
+#define MCLBYTES 256 /* size of data cluster */
+
+typedef struct MbufClust MbufClust_t;
+
+/* Buffer holds a span of data that lives in a cluster. Buffers are linked
+ * into chains with `next`, so a message of arbitrary length can be passed
+ * around by pointer. Clusters are reference counted, hence many buffers,
+ * possibly owned by different tasks, may refer to the same data without
+ * copying it. Data in a shared cluster must not be modified. Refer to BSD's
+ * mbuf(9). */
+typedef struct Mbuf {
+  struct Mbuf *next;  /* next buffer in the chain */
+  uint8_t *data;      /* beginning of valid data */
+  size_t len;         /* number of valid bytes at `data` */
+  MbufClust_t *clust; /* storage that `data` points into */
+  Msg_t msg;          /* lets the chain travel through a message port */
+} Mbuf_t;
+
+/* Returns an empty buffer with a cluster of MCLBYTES bytes of its own.
+ * Returns NULL if there's no memory left. */
+Mbuf_t *MbufAlloc(void);
+
+/* Returns a buffer that refers to `len` bytes at `data`, which must lie within
+ * the cluster of `m`. Nothing is copied. Returns NULL if there's no memory. */
+Mbuf_t *MbufShare(Mbuf_t *m, const void *data, size_t len);
+
+/* Releases the buffer and its reference to the cluster. The cluster is freed
+ * along with the last buffer referring to it. Returns the following buffer. */
+Mbuf_t *MbufFree(Mbuf_t *m);
+
+/* Releases all buffers of the chain. */
+void MbufFreeChain(Mbuf_t *m);
+
+/* Returns the number of valid bytes in the chain. */
+size_t MbufChainLen(Mbuf_t *m);
+
+/* Returns the number of bytes that can be appended to the data in `m`.
+ * Shared clusters cannot be extended, so in such case it is zero. */
+size_t MbufTrailing(Mbuf_t *m);
+
+/* Copies `len` bytes from `buf` into a new chain. Returns NULL if there's not
+ * enough memory. */
+Mbuf_t *MbufCopyIn(const void *buf, size_t len);
+
+/* Passes the chain to the owner of `mp`, which becomes the chain owner. The
+ * sender does not wait for a reply and must not touch the chain afterwards.
+ * Returns EAGAIN if all slots of `mp` are taken, 0 otherwise. */
+int MbufPut(MsgPort_t *mp, Mbuf_t *m);
+
+/* Takes the oldest chain sent to `mp`. Only the owner of `mp` can call it.
+ * Returns NULL if there are no chains pending. */
+Mbuf_t *MbufGet(MsgPort_t *mp);
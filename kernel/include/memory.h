@@ -2,12 +2,150 @@
 
 #include <sys/types.h>
 
+typedef struct File File_t;
+
+/* Unless MF_CHIP or MF_FAST is given, memory is taken from the fastest tier
+ * that can satisfy the request, i.e. fast, then slow, then chip memory. */
 typedef enum MemFlags {
-  MF_ZERO = 1, /* clear out allocated memory */
-  MF_CHIP = 2, /* allocate block for use with custom chipset */
+  MF_ANY_PREFER_FAST = 0, /* any memory, but fast memory is preferred */
+  MF_ZERO = 1,            /* clear out allocated memory */
+  MF_CHIP = 2,            /* allocate block for use with custom chipset */
+  MF_FAST = 4,            /* allocate block in fast memory only */
+  MF_LARGEST = 8,         /* MemAvail: return size of the largest block */
+  MF_TRY = 16,            /* return NULL rather than call the failed hook */
 } MemFlags_t;
 
+/* Subsystem tags used by heap profiler to account allocated memory.
+ * Pass one with MemAlloc flags, e.g. `MF_CHIP | MF_TAG(MT_DISPLAY)`. */
+typedef enum MemTag {
+  MT_NONE,    /* untagged allocations */
+  MT_RTOS,    /* FreeRTOS internals: task stacks, TCBs, queues */
+  MT_KERNEL,  /* kernel objects: files, message ports, ring buffers */
+  MT_PROC,    /* user process stacks and executable images */
+  MT_DRIVER,  /* device driver state */
+  MT_DISPLAY, /* bitmaps, copper lists and display state */
+  MT_FLOPPY,  /* floppy track buffers */
+  MT_TTY,     /* terminal and serial port queues */
+  MT_COUNT,
+} MemTag_t;
+
+#define MF_TAGSHIFT 8
+#define MF_TAG(t) ((t) << MF_TAGSHIFT)
+#define MF_TAGOF(f) (((f) >> MF_TAGSHIFT) & 255)
+
 void *MemAlloc(size_t size, MemFlags_t flags);
+/* Returns block with address aligned to `align`, which must be a power of two.
+ * Note that MemRealloc does not preserve alignment greater than 16 bytes. */
+void *MemAllocAligned(size_t size, size_t align, MemFlags_t flags);
 void MemFree(void *ptr);
 void *MemRealloc(void *ptr, size_t size);
 void MemCheck(int verbose);
+
+/* Returns the number of free bytes in memory tiers selected by `flags`. */
+size_t MemAvail(MemFlags_t flags);
+
+/* Counters of MemRealloc outcomes since boot. */
+typedef struct MemReallocStats {
+  uint32_t inplace; /* block was resized without moving data */
+  uint32_t slid;    /* block was grown into preceding free block */
+  uint32_t moved;   /* block was moved: allocate, copy and free */
+} MemReallocStats_t;
+
+void MemGetReallocStats(MemReallocStats_t *st);
+
+/* Counters of memory clearing since boot. */
+typedef struct MemZeroStats {
+  uint32_t saved;   /* MF_ZERO bytes that did not need clearing */
+  uint32_t cleared; /* free bytes cleared by MemIdle */
+  uint32_t eager;   /* freed bytes cleared to keep a free block clear */
+} MemZeroStats_t;
+
+void MemGetZeroStats(MemZeroStats_t *st);
+
+/* Clears a bit of free memory, so that MF_ZERO requests can be satisfied
+ * without clearing. Meant to be called from vApplicationIdleHook. */
+void MemIdle(void);
+
+/* Memory pressure levels passed to shrink callbacks. */
+typedef enum MemPressure {
+  MP_NONE = 0,     /* there is enough memory */
+  MP_LOW = 1,      /* release memory that is cheap to recreate */
+  MP_CRITICAL = 2, /* allocation fails unless everything possible is released */
+} MemPressure_t;
+
+/* Shrink callback releases memory of kind given by `flags` (MF_CHIP, MF_FAST
+ * or any if neither is set) and returns the number of bytes released. `size`
+ * is the size of failed allocation. It is called with the scheduler suspended,
+ * so it must not block, e.g. it may only take locks with zero timeout. */
+typedef size_t (*MemShrinkFunc_t)(void *data, MemFlags_t flags,
+                                  MemPressure_t level, size_t size);
+
+typedef struct MemShrinker {
+  struct MemShrinker *next;
+  MemShrinkFunc_t shrink;
+  void *data;
+  int priority;
+} MemShrinker_t;
+
+/* Define shrinker to be used with (Add|Rem)MemShrinker. Priority is between
+ * -128 (called last) and 127 (called first). */
+#define MEMSHRINKER(PRI, CODE, DATA)                                           \
+  (MemShrinker_t) {                                                            \
+    .next = NULL, .shrink = (CODE), .data = (DATA), .priority = (PRI)          \
+  }
+#define MEMSHRINKER_DEFINE(NAME, PRI, CODE, DATA)                              \
+  static MemShrinker_t *NAME = &MEMSHRINKER(PRI, CODE, DATA)
+
+/* Register shrink callback. When an allocation is about to fail, shrinkers are
+ * called in order of priority, first at MP_LOW and then at MP_CRITICAL level,
+ * until the allocation succeeds. */
+void AddMemShrinker(MemShrinker_t *ms);
+
+/* Unregister shrink callback. */
+void RemMemShrinker(MemShrinker_t *ms);
+
+/* Returns pressure level of memory kind given by `flags` as above. The level
+ * is raised when shrinkers are called and drops back to MP_NONE when an eighth
+ * of that memory is free again. Caches should not grow under pressure. */
+MemPressure_t MemPressure(MemFlags_t flags);
+
+/* Allocator calls recorded by kernel built with MEMTRACE option. */
+typedef enum MemTraceOp {
+  MTR_ALLOC = 1,   /* ptr = MemAllocAligned(size, arg, flags) */
+  MTR_FREE = 2,    /* MemFree(ptr) */
+  MTR_REALLOC = 3, /* ptr = MemRealloc(arg, size) */
+} MemTraceOp_t;
+
+#define MEMTRACE_MAGIC 0x4d545243 /* 'MTRC' */
+
+/* Each dump is a header followed by `count` records. Fields are written in
+ * native (i.e. big-endian) byte order. */
+typedef struct MemTraceHdr {
+  uint32_t magic;
+  uint32_t count;   /* number of records that follow */
+  uint32_t dropped; /* records overwritten before they were dumped */
+} MemTraceHdr_t;
+
+typedef struct MemTraceRec {
+  uint32_t tick;  /* xTaskGetTickCount at the time of the call */
+  uint16_t op;    /* one of MTR_* */
+  uint16_t flags; /* MemFlags_t including the tag */
+  uint32_t size;  /* requested size in bytes */
+  uint32_t ptr;   /* returned or released pointer */
+  uint32_t arg;   /* alignment for MTR_ALLOC, old pointer for MTR_REALLOC */
+} MemTraceRec_t;
+
+/* Writes records collected since previous call, e.g. to serial port.
+ * Without MEMTRACE option only an empty header is written. */
+void MemTraceDump(File_t *f);
+
+typedef struct MemTraceStats {
+  uint32_t records; /* calls recorded since boot */
+  uint32_t walkmax; /* the longest walk over a free block list */
+} MemTraceStats_t;
+
+void MemGetTraceStats(MemTraceStats_t *st);
+
+/* Writes heap usage report to a file. If the kernel was built with MEMPROF
+ * option, it also includes memory use per subsystem and per call site. */
+void MemDumpStats(File_t *f);
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <sys/types.h>
+#include <memory.h>
+
+typedef struct MemSlab MemSlab_t;
+
+/* Pool of fixed-size objects. Objects are carved out of slabs that are
+ * allocated with MemAlloc, each holding `count` objects. Free objects are kept
+ * on a singly linked list threaded through their first word, hence there's no
+ * per-object header and both allocation and release take constant time. */
+typedef struct MemPool {
+  void *freelst;    /* first free object */
+  MemSlab_t *slabs; /* slabs owned by the pool */
+  size_t objsize;   /* object size rounded up to pointer size */
+  uint16_t count;   /* number of objects in a slab */
+  MemFlags_t flags; /* MF_CHIP for slabs, MF_ZERO clears allocated objects */
+} MemPool_t;
+
+#define MEMPOOL(SIZE, COUNT, FLAGS)                                            \
+  (MemPool_t) {                                                                \
+    .freelst = NULL, .slabs = NULL,                                            \
+    .objsize = roundup((SIZE), sizeof(void *)), .count = (COUNT),              \
+    .flags = (FLAGS)                                                           \
+  }
+
+/* Define statically allocated pool. Slabs are allocated on first use. */
+#define MEMPOOL_DEFINE(NAME, SIZE, COUNT, FLAGS)                               \
+  static MemPool_t *NAME = &MEMPOOL(SIZE, COUNT, FLAGS)
+
+/* Create a pool of objects of `objsize` bytes. The pool grows by a slab of
+ * `count` objects each time it runs out of free objects. */
+MemPool_t *MemPoolCreate(size_t objsize, size_t count, MemFlags_t flags);
+
+/* Release all slabs, i.e. all objects must have been returned to the pool! */
+void MemPoolDestroy(MemPool_t *mp);
+
+/* Returns an object or NULL when a new slab could not be allocated. */
+void *MemPoolAlloc(MemPool_t *mp);
+
+/* Return an object to the pool it was allocated from. */
+void MemPoolFree(MemPool_t *mp, void *ptr);
@@ -1,13 +1,15 @@
 #pragma once
 
 #include <sys/types.h>
+#include <sys/queue.h>
 
 typedef struct tskTaskControlBlock *TaskHandle_t;
 typedef struct MsgPort MsgPort_t;
 
 typedef struct Msg {
-  void *data;        /* data associated with the message */
-  TaskHandle_t task; /* waits for the message to be replied, NULL when done */
+  TAILQ_ENTRY(Msg) node;      /* link on list of pending messages */
+  void *data;                 /* data associated with the message */
+  TaskHandle_t volatile task; /* waits for reply, NULL when done */
 } Msg_t;
 
 #define MSG(_data)                                                             \
@@ -15,21 +17,48 @@ typedef struct Msg {
     .data = (_data), .task = NULL                                              \
   }
 
-/* A message port stores at most one `Msg` message. The port must be associated
- * with a single `owner` task. Whenever a message arrives the task is notified
- * with NB_MSGPORT. A message occupies the port until it is replied. */
-MsgPort_t *MsgPortCreate(TaskHandle_t owner);
+/* A message port stores up to `depth` pending `Msg` messages in order of
+ * arrival. The port must be associated with a single `owner` task. Whenever a
+ * message arrives the task is notified with NB_MSGPORT. A message occupies
+ * a slot in the port until it is replied. */
+MsgPort_t *MsgPortCreate(TaskHandle_t owner, size_t depth);
 void MsgPortDelete(MsgPort_t *mp);
 
-/* Waits for `mp` to become empty.
- * Then it puts message and sends NB_MSGPORT `owner` task. */
+/* Puts `msg` into `mp` and sends NB_MSGPORT to `owner` task. Never blocks.
+ * The message must stay valid until it's replied, see CheckMsg & WaitMsg.
+ * Returns EAGAIN if all slots of `mp` are taken, 0 otherwise. */
+int PutMsg(MsgPort_t *mp, Msg_t *msg);
+
+/* Returns true if `msg` sent with PutMsg has been replied already. */
+static inline bool CheckMsg(Msg_t *msg) {
+  return msg->task == NULL;
+}
+
+/* Waits for `msg` sent with PutMsg to be replied. Note that it consumes
+ * NB_MSGPORT notifications, so a task that owns a message port must check
+ * the port afterwards. */
+void WaitMsg(Msg_t *msg);
+
+/* Waits for a free slot in `mp`, puts message there and waits for reply. */
 void DoMsg(MsgPort_t *mp, Msg_t *msg);
 
 /* Get message data is always non-blocking operation.
  * Only `mp` owner can fetch messages from a message port.
- * Returns data associated with message or NULL. */
+ * Returns data associated with the oldest message or NULL. */
 void *GetMsgData(MsgPort_t *mp);
 
-/* Empties `mp` and sends a NB_MSGPORT notification to the task that sent
- * the message. Clears out `Msg::task` when the message is replied. */
+/* Lets `mp` owner iterate over all pending messages in order of arrival.
+ * Returns the message following `msg`, or the oldest one if `msg` is NULL.
+ * Returns NULL if there are no more messages. */
+Msg_t *NextMsg(MsgPort_t *mp, Msg_t *msg);
+
+/* Removes the oldest message from `mp` and sends a NB_MSGPORT notification to
+ * the task that sent the message. Clears out `Msg::task` when it's replied. */
 void ReplyMsg(MsgPort_t *mp);
+
+/* Same as above, but replies to any pending `msg` obtained with NextMsg. */
+void ReplyToMsg(MsgPort_t *mp, Msg_t *msg);
+
+/* Removes pending `msg` from `mp` without notifying the sender, which learns
+ * about completion by other means. Clears out `Msg::task`. */
+void RemoveMsg(MsgPort_t *mp, Msg_t *msg);
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <atomic.h>
+#include <sleepq.h>
+
+/* Mutex that is acquired with a single TAS instruction if nobody holds it.
+ * Only tasks that find it locked go to sleep, so uncontended lock and unlock
+ * never enter the scheduler. Refer to BeOS benaphores.
+ *
+ * Unlike FreeRTOS mutexes it is neither recursive nor does it implement
+ * priority inheritance. A zeroed structure is an unlocked mutex. */
+typedef struct Mutex {
+  volatile uint8_t locked;   /* set by the owner with TAS */
+  volatile uint32_t waiters; /* number of tasks sleeping on the mutex */
+} Mutex_t;
+
+static inline void MutexInit(Mutex_t *m) {
+  m->locked = 0;
+  m->waiters = 0;
+}
+
+/* Slow path of MutexLock taken when the mutex is held by another task. */
+void MutexWait(Mutex_t *m);
+
+/* Returns true if the mutex was acquired without blocking. */
+static inline bool MutexTryLock(Mutex_t *m) {
+  return AtomicTestAndSet(&m->locked);
+}
+
+static inline void MutexLock(Mutex_t *m) {
+  if (!AtomicTestAndSet(&m->locked))
+    MutexWait(m);
+}
+
+static inline void MutexUnlock(Mutex_t *m) {
+  AtomicClear(&m->locked);
+  if (m->waiters)
+    (void)WakeupOne(m);
+}
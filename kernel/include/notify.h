@@ -11,6 +11,7 @@ typedef enum NotifyBits {
   NB_MSGPORT = BIT(0), /* used by message ports, refer to <msgport.h> */
   NB_EVENT = BIT(1),   /* used by kernel events, refer to <event.h> */
   NB_IRQ = BIT(2),     /* use it when waiting for an interrupt to happen */
+  NB_SLEEP = BIT(3),   /* used by sleep queues, refer to <sleepq.h> */
 } NotifyBits_t;
 
 /* Send notification `bits` to `task`. */
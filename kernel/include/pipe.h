@@ -3,5 +3,10 @@
 typedef struct File File_t;
 
 /* Creates a pipe object. Returns read end file object through `rfilep` and
- * write end through `wfilep`. Returns 0 on success, otherwise errno code. */
+ * write end through `wfilep`. Returns 0 on success, otherwise errno code.
+ *
+ * Reading from a pipe with no data blocks until some data is written, unless
+ * F_NONBLOCK is set, or returns end of file if write end was closed. Writing
+ * blocks while the pipe is full and fails with EPIPE once read end is closed.
+ * Both ends report EVFILT_READ and EVFILT_WRITE events respectively. */
 int PipeAlloc(File_t **rfilep, File_t **wfilep);
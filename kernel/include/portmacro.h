@@ -35,7 +35,10 @@ typedef uint32_t TickType_t;
  * Following macros invocations silence out those warnings. */
 #define portUNUSED(x)
 #define portSETUP_TCB(pxTCB)
-#define portCLEAN_UP_TCB(pxTCB)
+#define portCLEAN_UP_TCB(pxTCB) vPortCleanUpTCB(pxTCB)
+
+/* Releases resources associated with task before its TCB is freed. */
+void vPortCleanUpTCB(void *pxTCB);
 
 /* Hardware specifics. */
 #define portBYTE_ALIGNMENT 4
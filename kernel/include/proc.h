@@ -5,6 +5,7 @@
 #include <setjmp.h>
 
 #define TLS_PROC 0
+#define TLS_MEMCACHE 1
 #define MAXFILES 16
 
 #define UPROC_STKSZ (configMINIMAL_STACK_SIZE * 8)
@@ -35,6 +36,9 @@ typedef struct Proc {
   jmp_buf retctx;          /* context restored when process finishes */
   UserCtx_t usrctx;        /* initial user context */
   Hunk_t *hunk;            /* first hunk of executable file */
+  void *heap;              /* last chunk of heap grown by sbrk */
+  intptr_t brk;            /* current program break */
+  intptr_t brkend;         /* end of last heap chunk */
   File_t *fdtab[MAXFILES]; /* file descriptor table */
 } Proc_t;
 
@@ -46,5 +50,9 @@ void ProcFini(Proc_t *proc);
 int ProcLoadImage(Proc_t *proc, File_t *exe);
 void ProcFreeImage(Proc_t *proc);
 void ProcSetArgv(Proc_t *proc, char *const *argv);
+/* Moves program break by `incr` bytes and returns its old value. Memory is
+ * contiguous between calls only until current heap chunk is used up. Zero
+ * `incr` allocates nothing, so the break is NULL until the heap is grown. */
+int ProcSbrk(Proc_t *proc, intptr_t incr, void **ptrp);
 void ProcEnter(Proc_t *proc);
 __noreturn void ProcExit(Proc_t *proc, int exitcode);
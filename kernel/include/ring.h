@@ -1,38 +1,68 @@
 #pragma once
 
 #include <sys/types.h>
+#include <memory.h>
 
 typedef struct IoReq IoReq_t;
 
+/* Single-producer single-consumer ring buffer. The producer only ever moves
+ * `head` and the consumer only ever moves `tail`, so a task and an interrupt
+ * handler can pass data through the buffer without masking interrupts.
+ * Both indices run freely and are reduced modulo `size` on access. */
 typedef struct Ring {
-  size_t head;    /* producing data moves head forward */
-  size_t tail;    /* consuming data moves tail forward */
-  size_t count;   /* number of bytes currently stored in the buffer */
-  size_t size;    /* total size of the buffer */
-  uint8_t data[]; /* buffer that stores data */
+  volatile size_t head; /* producing data moves head forward */
+  volatile size_t tail; /* consuming data moves tail forward */
+  size_t size;          /* total size of the buffer, a power of two */
+  uint8_t data[];       /* buffer that stores data */
 } Ring_t;
 
+/* Number of bytes currently stored in the buffer. */
+static inline size_t RingUsed(Ring_t *buf) {
+  return buf->head - buf->tail;
+}
+
 static inline bool RingEmpty(Ring_t *buf) {
-  return buf->count == 0;
+  return buf->head == buf->tail;
 }
 
 static inline bool RingFull(Ring_t *buf) {
-  return buf->count == buf->size;
+  return RingUsed(buf) == buf->size;
 }
 
 /* Put `byte` into `buf`. You MUST check if `buf` is non-full before! */
 void RingPutByte(Ring_t *buf, uint8_t byte);
 
-/* Put `byte` into `buf`. You MUST check if `buf` is non-empty before! */
+/* Get `byte` from `buf`. You MUST check if `buf` is non-empty before! */
 uint8_t RingGetByte(Ring_t *buf);
 
-/* Transfer data from `req` into `buf`. Up to `req::left` bytes will be
- * transferred, but no more than `buf::size` - `buf::count`. */
-void RingRead(Ring_t *buf, IoReq_t *req);
+/* Returns in `ptrp` and `lenp` the longest contiguous span of free space in
+ * `buf`. Producer may fill in up to `*lenp` bytes directly and then publish
+ * them with RingCommitWrite. `*lenp` is 0 if `buf` is full. */
+void RingReserveWrite(Ring_t *buf, uint8_t **ptrp, size_t *lenp);
+
+/* Make `len` bytes filled in after RingReserveWrite visible to consumer. */
+void RingCommitWrite(Ring_t *buf, size_t len);
+
+/* Returns in `ptrp` and `lenp` the longest contiguous span of data stored in
+ * `buf`. Consumer may use up to `*lenp` bytes directly and then release them
+ * with RingConsumeRead. `*lenp` is 0 if `buf` is empty. */
+void RingPeekRead(Ring_t *buf, uint8_t **ptrp, size_t *lenp);
+
+/* Give `len` bytes obtained with RingPeekRead back to producer. */
+void RingConsumeRead(Ring_t *buf, size_t len);
 
 /* Transfer data from `buf` into `req`. Up to `req::left` bytes will be
- * transferred, but no more than `buf::count`. */
+ * transferred, but no more than RingUsed(buf). Consumer side. */
+void RingRead(Ring_t *buf, IoReq_t *req);
+
+/* Transfer data from `req` into `buf`. Up to `req::left` bytes will be
+ * transferred, but no more than free space in `buf`. Producer side. */
 void RingWrite(Ring_t *buf, IoReq_t *req);
 
-/* Allocate and initialize a ring buffer of `size` bytes. */
-Ring_t *RingAlloc(size_t size);
+/* Allocate and initialize a ring buffer of `size` bytes.
+ * `size` must be a power of two. `flags` are passed to MemAlloc, so with
+ * MF_TRY it returns NULL if there's not enough memory. */
+Ring_t *RingAlloc(size_t size, MemFlags_t flags);
+
+/* Release memory used by ring buffer allocated with RingAlloc. */
+void RingFree(Ring_t *buf);
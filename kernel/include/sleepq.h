@@ -0,0 +1,28 @@
+#pragma once
+
+#include <FreeRTOS/FreeRTOS.h>
+
+/* Sleep queues let a task wait for a condition identified by an arbitrary
+ * address called wait channel, usually the address of an object that the
+ * condition concerns. Channels are hashed into a fixed table of queues, so
+ * there's nothing to set up before sleeping on a channel.
+ *
+ * The sleeper must check the condition and call Sleep atomically with regard
+ * to the waker, i.e. in a critical section if the waker is an interrupt
+ * handler. Sleep may return before the condition holds, so call it in a loop.
+ * Refer to BSD's tsleep(9) and wakeup(9). */
+
+/* Puts calling task to sleep on `chan` until it's woken up or `timeout`
+ * ticks pass. Returns 0 if woken up, otherwise ETIMEDOUT. */
+int Sleep(const void *chan, TickType_t timeout);
+
+/* Wakes up all tasks sleeping on `chan`. */
+void Wakeup(const void *chan);
+
+/* Wakes up the task that has been sleeping on `chan` for the longest time.
+ * Returns true if there was such a task. */
+bool WakeupOne(const void *chan);
+
+/* Same as above, but intended to be called in an interrupt service routine. */
+void WakeupFromISR(const void *chan);
+bool WakeupOneFromISR(const void *chan);
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <FreeRTOS/FreeRTOS.h>
+
+#include <sys/types.h>
+#include <sys/poll.h>
+
+typedef struct File File_t;
+typedef struct WaitSet WaitSet_t;
+
+/* File in a wait set along with conditions the owner is interested in.
+ * `events` and `revents` use POLLIN and POLLOUT flags known from poll. */
+typedef struct WaitItem {
+  File_t *file;
+  intptr_t udata; /* passed back to the owner along with ready file */
+  short events;   /* conditions to wait for */
+  short revents;  /* conditions that hold, filled in by WaitSetWait */
+} WaitItem_t;
+
+/* Wait set keeps the calling task registered for can-read and can-write
+ * events of its files, so it must be used by a single task only. Files that
+ * share an event source, e.g. duplicated descriptors, share the registration.
+ *
+ * Returns NULL if there's no memory left. */
+WaitSet_t *WaitSetAlloc(int size);
+
+/* Removes all files from the set and releases memory. */
+void WaitSetFree(WaitSet_t *ws);
+
+/* Add `f` to the set. Returns 0 on success, otherwise errno code. */
+int WaitSetAdd(WaitSet_t *ws, File_t *f, short events, intptr_t udata);
+
+/* Remove `f` from the set. Returns 0 on success, otherwise errno code. */
+int WaitSetDel(WaitSet_t *ws, File_t *f);
+
+/* Waits up to `timeout` ticks for files in the set to become ready. Copies
+ * at most `nready` items of ready files into `ready` array and returns their
+ * number through `countp`. Only files that are ready are reported, so the
+ * caller does not have to try each of them. Returns 0 or errno code. */
+int WaitSetWait(WaitSet_t *ws, WaitItem_t *ready, int nready,
+                TickType_t timeout, int *countp);
@@ -0,0 +1,69 @@
+#include <FreeRTOS/FreeRTOS.h>
+#include <FreeRTOS/task.h>
+
+#include <ioreq.h>
+#include <mbuf.h>
+#include <notify.h>
+
+void IoReqDone(IoReq_t *req, int error) {
+  req->error = error;
+
+  if (!req->async)
+    return;
+
+  /* The submitter may reuse the request as soon as `busy` is cleared. */
+  TaskHandle_t task = req->task;
+  IoReqDone_t done = req->done;
+  __compiler_membar();
+  req->busy = false;
+
+  if (done)
+    done(req);
+  else
+    NotifySend(task, NB_EVENT);
+}
+
+int IoReqWait(IoReq_t *req) {
+  /* Completion of other requests may wake us up as well. */
+  while (req->busy)
+    (void)NotifyWait(NB_EVENT, portMAX_DELAY);
+  return req->error;
+}
+
+int IoReqSend(MsgPort_t *mp, IoReq_t *req) {
+  req->msg = MSG(req);
+  if (req->async)
+    return PutMsg(mp, &req->msg);
+  DoMsg(mp, &req->msg);
+  return req->error;
+}
+
+void IoReqReply(MsgPort_t *mp, IoReq_t *req, int error) {
+  if (req->async) {
+    RemoveMsg(mp, &req->msg);
+    IoReqDone(req, error);
+  } else {
+    req->error = error;
+    ReplyToMsg(mp, &req->msg);
+  }
+}
+
+void IoReqSetVec(IoReq_t *req, const struct iovec *iov, int iovcnt) {
+  req->left = 0;
+  for (int i = 0; i < iovcnt; i++)
+    req->left += iov[i].iov_len;
+  req->seglen = 0;
+  req->iov = iov;
+  req->iovcnt = iovcnt;
+  req->mbuf = NULL;
+  IoReqAdvance(req, 0);
+}
+
+void IoReqSetChain(IoReq_t *req, Mbuf_t *m) {
+  req->left = MbufChainLen(m);
+  req->rbuf = (char *)m->data;
+  req->seglen = m->len;
+  req->iovcnt = 0;
+  req->mbuf = m;
+  IoReqAdvance(req, 0);
+}
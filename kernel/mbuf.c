@@ -0,0 +1,118 @@
+#include <FreeRTOS/FreeRTOS.h>
+
+#include <atomic.h>
+#include <mbuf.h>
+#include <mempool.h>
+#include <string.h>
+
+#define DEBUG 0
+#include <debug.h>
+
+struct MbufClust {
+  volatile uint32_t refcnt; /* number of buffers referring to the cluster */
+  uint8_t buf[MCLBYTES];
+};
+
+MEMPOOL_DEFINE(MbufPool, sizeof(Mbuf_t), 32, MF_TAG(MT_KERNEL));
+MEMPOOL_DEFINE(ClustPool, sizeof(MbufClust_t), 16, MF_TAG(MT_KERNEL));
+
+static Mbuf_t *MbufInit(Mbuf_t *m, MbufClust_t *c, uint8_t *data,
+                        size_t len) {
+  m->next = NULL;
+  m->data = data;
+  m->len = len;
+  m->clust = c;
+  return m;
+}
+
+Mbuf_t *MbufAlloc(void) {
+  Mbuf_t *m = MemPoolAlloc(MbufPool);
+  if (m == NULL)
+    return NULL;
+
+  MbufClust_t *c = MemPoolAlloc(ClustPool);
+  if (c == NULL) {
+    MemPoolFree(MbufPool, m);
+    return NULL;
+  }
+
+  c->refcnt = 1;
+  return MbufInit(m, c, c->buf, 0);
+}
+
+Mbuf_t *MbufShare(Mbuf_t *m, const void *data, size_t len) {
+  MbufClust_t *c = m->clust;
+  uint8_t *ptr = (uint8_t *)data;
+
+  Assert(ptr >= c->buf && ptr + len <= c->buf + MCLBYTES);
+
+  Mbuf_t *n = MemPoolAlloc(MbufPool);
+  if (n == NULL)
+    return NULL;
+
+  AtomicInc(&c->refcnt);
+  return MbufInit(n, c, ptr, len);
+}
+
+Mbuf_t *MbufFree(Mbuf_t *m) {
+  Mbuf_t *next = m->next;
+  if (AtomicDecAndTest(&m->clust->refcnt))
+    MemPoolFree(ClustPool, m->clust);
+  MemPoolFree(MbufPool, m);
+  return next;
+}
+
+void MbufFreeChain(Mbuf_t *m) {
+  while (m != NULL)
+    m = MbufFree(m);
+}
+
+size_t MbufChainLen(Mbuf_t *m) {
+  size_t len = 0;
+  for (; m != NULL; m = m->next)
+    len += m->len;
+  return len;
+}
+
+size_t MbufTrailing(Mbuf_t *m) {
+  MbufClust_t *c = m->clust;
+  if (c->refcnt > 1)
+    return 0;
+  return c->buf + MCLBYTES - (m->data + m->len);
+}
+
+Mbuf_t *MbufCopyIn(const void *buf, size_t len) {
+  Mbuf_t *head = NULL, **tailp = &head;
+  const uint8_t *src = buf;
+
+  while (len > 0) {
+    Mbuf_t *m = MbufAlloc();
+    if (m == NULL) {
+      MbufFreeChain(head);
+      return NULL;
+    }
+    m->len = min(len, (size_t)MCLBYTES);
+    memcpy(m->data, src, m->len);
+    src += m->len;
+    len -= m->len;
+    *tailp = m;
+    tailp = &m->next;
+  }
+
+  return head;
+}
+
+int MbufPut(MsgPort_t *mp, Mbuf_t *m) {
+  m->msg = MSG(m);
+  return PutMsg(mp, &m->msg);
+}
+
+Mbuf_t *MbufGet(MsgPort_t *mp) {
+  Msg_t *msg = NextMsg(mp, NULL);
+  if (msg == NULL)
+    return NULL;
+  /* The sender is not waiting for a reply, so do not notify it. */
+  RemoveMsg(mp, msg);
+  DLOG("mbuf: received chain %p\n", msg->data);
+  return msg->data;
+}
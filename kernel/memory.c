@@ -1,4 +1,5 @@
 #include <FreeRTOS/FreeRTOS.h>
+#include <FreeRTOS/atomic.h>
 #include <FreeRTOS/task.h>
 
 #include <sys/cdefs.h>
@@ -8,13 +9,35 @@
 #include <memory.h>
 #include <debug.h>
 #include <boot.h>
+#include <proc.h>
+#include <file.h>
 
 #if (configSUPPORT_DYNAMIC_ALLOCATION == 0)
 #error This file must not be used if configSUPPORT_DYNAMIC_ALLOCATION is 0
 #endif
 
+#if (configNUM_THREAD_LOCAL_STORAGE_POINTERS <= TLS_MEMCACHE)
+#error Per-task memory cache needs a thread local storage pointer
+#endif
+
 #define DEBUG 0
 
+/* Set to 1 to build heap profiler in, see MemDumpStats. */
+#ifndef MEMPROF
+#define MEMPROF 0
+#endif
+
+/* Set to 1 to record allocator calls into a ring buffer, see MemTraceDump. */
+#ifndef MEMTRACE
+#define MEMTRACE 0
+#endif
+
+/* Set to 1 to reduce per-block overhead for small objects: blocks are aligned
+ * to 8 bytes and free list links are stored as 16-bit offsets. */
+#ifndef MEMCOMPACT
+#define MEMCOMPACT 0
+#endif
+
 #if DEBUG
 #define debug(fmt, ...) kprintf("%s: " fmt "\n", __func__, __VA_ARGS__)
 #else
@@ -25,12 +48,12 @@
 
 typedef uintptr_t word_t;
 
+#if MEMCOMPACT
+#define ALIGNMENT 8
+#else
 #define ALIGNMENT 16
+#endif
 #define CANARY 0xDEADC0DE
-
-/* Free block consists of header BT, pointer to previous and next free block,
- * payload and footer BT. */
-#define FREEBLK_SZ (4 * sizeof(word_t))
 /* Used block consists of header BT, user memory and canary. */
 #define USEDBLK_SZ (2 * sizeof(word_t))
 
@@ -40,28 +63,84 @@ typedef enum {
   USED = 1,     /* this block is used */
   PREVFREE = 2, /* previous block is free */
   ISLAST = 4,   /* last block in an arena */
+  /* Payload of free block past free list links is known to be cleared.
+   * Kept in high bits of size, since blocks are smaller than 1GiB. */
+  ZEROED = 0x40000000,
 } bt_flags;
 
+#if MEMCOMPACT
+/* Stored in payload of free blocks. Links are offsets from the beginning of
+ * an arena in ALIGNMENT units, hence arena size is limited to ARENA_MAXSZ. */
+typedef struct node {
+  uint16_t prev;
+  uint16_t next;
+} node_t;
+
+/* Free list guards must be placed at ALIGNMENT boundary to be addressable by
+ * compressed links. */
+typedef struct guard {
+  node_t node;
+} __aligned(ALIGNMENT) guard_t;
+
+#define ARENA_MAXSZ (65536 * ALIGNMENT)
+#else
 /* Stored in payload of free blocks. */
 typedef struct node {
   struct node *prev;
   struct node *next;
 } node_t;
 
-/* Structure kept in the header of each managed memory region. */
+typedef struct guard {
+  node_t node;
+} guard_t;
+
+#define ARENA_MAXSZ (-1U)
+#endif
+
+/* Free block consists of header BT, links to previous and next free block,
+ * payload and footer BT. */
+#define FREEBLK_SZ (2 * sizeof(word_t) + sizeof(node_t))
+/* Any split off part of a block smaller than that cannot become free. */
+#define MINBLK roundup(FREEBLK_SZ, ALIGNMENT)
+
+/* Free blocks are kept on segregated lists (bins) depending on their size.
+ * Blocks of up to EXACT_MAX bytes have a bin for each size. Bigger blocks are
+ * put into bins covering power-of-two ranges, e.g. (256, 512), [512, 1024)
+ * and so on. The last bin collects all blocks that are larger. */
+#define NBINS 32
+#define NEXACT 16
+#define EXACT_MAX (NEXACT * ALIGNMENT)
+
+/* Memory tiers in order of increasing CPU access speed. Chip memory is shared
+ * with custom chipset DMA. Slow memory (a.k.a. ranger memory) sits on chip
+ * bus, but is not accessible by DMA. Fast memory is CPU only. */
+typedef enum {
+  TIER_CHIP = 0,
+  TIER_SLOW = 1,
+  TIER_FAST = 2,
+  NTIERS = 3,
+} tier_t;
+
+/* Structure kept in the header of each managed memory region. Regions larger
+ * than ARENA_MAXSZ are split into several arenas. */
 typedef struct arena {
-  node_t freelst;     /* guard of free block list */
-  word_t *end;        /* first address after the arena */
-  uint32_t totalFree; /* total number of free bytes */
-  uint32_t minFree;   /* minimum recorded number of free bytes */
-  uint32_t pad[2];    /* make user address aligned to ALIGNMENT */
-  word_t start[];     /* first block in the arena */
+  struct arena *next;  /* next arena on the list */
+  word_t *end;         /* first address after the arena */
+  uint32_t totalFree;  /* total number of free bytes */
+  uint32_t minFree;    /* minimum recorded number of free bytes */
+  uint32_t binmap;     /* bitmap of non-empty bins */
+  uint32_t tier;       /* memory tier of the arena */
+  guard_t bins[NBINS]; /* guards of free block lists */
+  uint32_t pad;        /* make user address aligned to ALIGNMENT */
+  word_t start[];      /* first block in the arena */
 } arena_t;
 
-#define head (&ar->freelst)
+_Static_assert(offsetof(arena_t, start) % ALIGNMENT ==
+                 ALIGNMENT - sizeof(word_t),
+               "Payload of the first block is not aligned!");
 
 static inline word_t bt_size(word_t *bt) {
-  return *bt & ~(USED | PREVFREE | ISLAST);
+  return *bt & ~(USED | PREVFREE | ISLAST | ZEROED);
 }
 
 static inline int bt_used(word_t *bt) {
@@ -104,10 +183,24 @@ static inline bt_flags bt_get_islast(word_t *bt) {
   return *bt & ISLAST;
 }
 
+static inline bt_flags bt_get_zeroed(word_t *bt) {
+  return *bt & ZEROED;
+}
+
+/* Must only be called on free blocks, as footer is updated as well. */
+static inline void bt_set_zeroed(word_t *bt) {
+  *bt |= ZEROED;
+  *bt_footer(bt) |= ZEROED;
+}
+
 static inline void bt_clr_islast(word_t *bt) {
   *bt &= ~ISLAST;
 }
 
+static inline void bt_set_islast(word_t *bt) {
+  *bt |= ISLAST;
+}
+
 static inline void bt_clr_prevfree(word_t *bt) {
   *bt &= ~PREVFREE;
 }
@@ -130,25 +223,65 @@ static inline word_t *bt_prev(word_t *bt) {
   return (void *)bt - bt_size(ft);
 }
 
-/* These are only useful if node_t pointers are compressed. */
-static inline node_t *n_prev(node_t *node) {
-  return node->prev;
+#if MEMCOMPACT
+static inline node_t *n_ptr(arena_t *ar, uint16_t off) {
+  return (void *)ar + off * ALIGNMENT;
+}
+
+static inline uint16_t n_off(arena_t *ar, node_t *node) {
+  return ((void *)node - (void *)ar) / ALIGNMENT;
+}
+#else
+#define n_ptr(ar, ptr) (ptr)
+#define n_off(ar, node) (node)
+#endif
+
+#define n_prev(node) ar_n_prev(ar, (node))
+static inline node_t *ar_n_prev(__unused arena_t *ar, node_t *node) {
+  return n_ptr(ar, node->prev);
+}
+
+#define n_next(node) ar_n_next(ar, (node))
+static inline node_t *ar_n_next(__unused arena_t *ar, node_t *node) {
+  return n_ptr(ar, node->next);
+}
+
+#define n_setprev(node, prev) ar_n_setprev(ar, (node), (prev))
+static inline void ar_n_setprev(__unused arena_t *ar, node_t *node,
+                                node_t *prev) {
+  node->prev = n_off(ar, prev);
 }
 
-static inline node_t *n_next(node_t *node) {
-  return node->next;
+#define n_setnext(node, next) ar_n_setnext(ar, (node), (next))
+static inline void ar_n_setnext(__unused arena_t *ar, node_t *node,
+                                node_t *next) {
+  node->next = n_off(ar, next);
 }
 
-static inline void n_setprev(node_t *node, node_t *prev) {
-  node->prev = prev;
+/* Returns index of a bin that holds free blocks of `sz` bytes. */
+static inline unsigned bin_index(size_t sz) {
+  if (sz <= EXACT_MAX)
+    return sz / ALIGNMENT - 1;
+  unsigned bin = NEXACT;
+  for (sz /= 2 * EXACT_MAX; sz && bin < NBINS - 1; sz >>= 1)
+    bin++;
+  return bin;
 }
 
-static inline void n_setnext(node_t *node, node_t *next) {
-  node->next = next;
+static inline node_t *bin_head(arena_t *ar, unsigned bin) {
+  return &ar->bins[bin].node;
 }
 
+/* Free block that is being cleared by MemIdle. */
+static word_t *ZeroBlk;
+/* Set when a free block that is not cleared may exist. */
+static int ZeroPending;
+static MemZeroStats_t ZeroStats;
+
 #define n_insert(bt) ar_n_insert(ar, (bt))
 static inline void ar_n_insert(arena_t *ar, word_t *bt) {
+  unsigned bin = bin_index(bt_size(bt));
+  node_t *head = bin_head(ar, bin);
   node_t *node = bt_payload(bt);
   node_t *prev = n_prev(head);
 
@@ -157,50 +290,69 @@ static inline void ar_n_insert(arena_t *ar, word_t *bt) {
   n_setprev(node, prev);
   n_setnext(prev, node);
   n_setprev(head, node);
+
+  ar->binmap |= 1U << bin;
+  if (!bt_get_zeroed(bt))
+    ZeroPending = 1;
 }
 
-static inline void n_remove(word_t *bt) {
+#define n_remove(bt) ar_n_remove(ar, (bt))
+static inline void ar_n_remove(arena_t *ar, word_t *bt) {
+  /* Block is going to be split, merged or used, so stop clearing it. */
+  if (bt == ZeroBlk)
+    ZeroBlk = NULL;
+
   node_t *node = bt_payload(bt);
   node_t *prev = n_prev(node);
   node_t *next = n_next(node);
   n_setnext(prev, next);
   n_setprev(next, prev);
+
+  /* Only the guard is left on the list, so the bin became empty. */
+  if (prev == next)
+    ar->binmap &= ~(1U << bin_index(bt_size(bt)));
 }
 
 static inline size_t blksz(size_t size) {
   return roundup(size + USEDBLK_SZ, ALIGNMENT);
 }
 
-#if 1
-/* First fit */
-static word_t *find_fit(arena_t *ar, size_t reqsz) {
-  for (node_t *n = n_next(head); n != head; n = n_next(n)) {
-    word_t *bt = bt_fromptr(n);
-    if (bt_size(bt) >= reqsz)
-      return bt;
-  }
-  return NULL;
+#if MEMTRACE
+static uint32_t WalkMax; /* the longest free list walk so far */
+
+static inline void trace_walk(unsigned walk) {
+  if (walk > WalkMax)
+    WalkMax = walk;
 }
 #else
-/* Best fit */
+#define trace_walk(walk)
+#endif
+
+/* Good fit: each block in a bin above the one that corresponds to `reqsz` is
+ * large enough, so take the first block from the nearest non-empty bin. Only
+ * if there is none, search the bin of `reqsz` itself with first fit policy.
+ * That is not needed for exact bins, since all their blocks fit. */
 static word_t *find_fit(arena_t *ar, size_t reqsz) {
-  word_t *best = NULL;
-  size_t bestsz = INT_MAX;
+  unsigned bin = bin_index(reqsz);
+  uint32_t map = ar->binmap & ((bin < NEXACT) ? -1U << bin : -2U << bin);
+
+  if (map)
+    return bt_fromptr(n_next(bin_head(ar, ffs(map) - 1)));
 
-  for (node_t *n = n_next(head); n != head; n = n_next(n)) {
+  if (bin < NEXACT)
+    return NULL;
+
+  node_t *head = bin_head(ar, bin);
+  word_t *found = NULL;
+  unsigned walk = 0;
+  for (node_t *n = n_next(head); n != head && !found; n = n_next(n), walk++) {
     word_t *bt = bt_fromptr(n);
-    size_t sz = bt_size(bt);
-    if (sz == reqsz)
-      return bt;
-    if (sz > reqsz && sz < bestsz) {
-      best = bt;
-      bestsz = sz;
-    }
+    if (bt_size(bt) >= reqsz)
+      found = bt;
   }
-
-  return best;
+  trace_walk(walk);
+  return found;
 }
-#endif
 
 static inline void ar_dec_free(arena_t *ar, size_t sz) {
   /* Decrease the amount of available memory. */
@@ -213,8 +365,12 @@ static inline void ar_dec_free(arena_t *ar, size_t sz) {
 static void ar_init(arena_t *ar, void *end) {
   size_t sz = end - (void *)ar->start;
 
-  n_setprev(head, head);
-  n_setnext(head, head);
+  for (unsigned bin = 0; bin < NBINS; bin++) {
+    node_t *head = bin_head(ar, bin);
+    n_setprev(head, head);
+    n_setnext(head, head);
+  }
+  ar->binmap = 0;
   ar->end = end;
   ar->totalFree = sz - USEDBLK_SZ;
   ar->minFree = INT_MAX;
@@ -223,41 +379,133 @@ static void ar_init(arena_t *ar, void *end) {
   n_insert(bt);
 }
 
-static void *ar_malloc(arena_t *ar, size_t size) {
+/* Returns offset of the first (or the last if `reverse` is set) position
+ * within free block `bt` where a block of `reqsz` bytes with payload aligned
+ * to `align` can be placed. If there's none, then returned offset plus
+ * `reqsz` exceeds size of `bt`. */
+static size_t aligned_offset(word_t *bt, size_t reqsz, size_t align,
+                             int reverse) {
+  uintptr_t start = (uintptr_t)bt_payload(bt);
+  uintptr_t pos = roundup(start, align);
+  /* Leading slack must be large enough to become a free block. */
+  if (pos > start && pos - start < MINBLK)
+    pos += align;
+  if (reverse && bt_size(bt) >= reqsz) {
+    uintptr_t last = rounddown(start + bt_size(bt) - reqsz, align);
+    if (last > pos && last - start >= MINBLK)
+      pos = last;
+  }
+  return pos - start;
+}
+
+/* Any block large enough to cover the worst case slack will do. Only if there
+ * is none, look for a block that happens to be placed at a suitable address.
+ * The slack is either less than `align` or got bumped by `align` in
+ * aligned_offset because it could not become a free block. */
+static word_t *find_aligned_fit(arena_t *ar, size_t reqsz, size_t align) {
+  if (align == ALIGNMENT)
+    return find_fit(ar, reqsz);
+
+  size_t slack = align - ALIGNMENT + (MINBLK > ALIGNMENT ? MINBLK : 0);
+  word_t *bt = find_fit(ar, reqsz + slack);
+  if (bt != NULL)
+    return bt;
+
+  uint32_t map = ar->binmap & (-1U << bin_index(reqsz));
+  unsigned walk = 0;
+  for (unsigned bin = 0; map && !bt; bin++, map >>= 1) {
+    if (!(map & 1))
+      continue;
+    node_t *head = bin_head(ar, bin);
+    for (node_t *n = n_next(head); n != head && !bt; n = n_next(n), walk++) {
+      if (aligned_offset(bt_fromptr(n), reqsz, align, 0) + reqsz <=
+          bt_size(bt_fromptr(n)))
+        bt = bt_fromptr(n);
+    }
+  }
+  trace_walk(walk);
+  return bt;
+}
+
+/* Turns a part of free block `bt`, that starts at `off` and is `reqsz` bytes
+ * long, into a used block. Leading and trailing slack is returned to free
+ * lists and stays cleared if `bt` was. The block must have been removed from
+ * free lists beforehand. */
+static word_t *ar_carve(arena_t *ar, word_t *bt, size_t off, size_t reqsz) {
+  bt_flags is_last = bt_get_islast(bt);
+  bt_flags zeroed = bt_get_zeroed(bt);
+  size_t sz = bt_size(bt);
+  size_t tail = sz - off - reqsz;
+  size_t memsz = sz - USEDBLK_SZ;
+
+  /* Trailing slack too small to become a free block goes with used one. */
+  if (tail < MINBLK) {
+    reqsz += tail;
+    tail = 0;
+  }
+
+  if (off > 0) {
+    bt_make(bt, off, FREE | zeroed);
+    n_insert(bt);
+    memsz -= off - USEDBLK_SZ;
+    bt = (void *)bt + off;
+  }
+
+  bt_make(bt, reqsz, USED | (off ? PREVFREE : 0) | (tail ? 0 : is_last));
+
+  word_t *next = bt_next(bt);
+  if (tail > 0) {
+    bt_make(next, tail, FREE | is_last | zeroed);
+    n_insert(next);
+    memsz -= tail - USEDBLK_SZ;
+  } else if (!is_last) {
+    /* Nothing to split? Then previous block is not free anymore! */
+    bt_clr_prevfree(next);
+  }
+
+  ar_dec_free(ar, memsz);
+  return bt;
+}
+
+/* Payload of allocated block is aligned to `align`, which must be a power of
+ * two not smaller than ALIGNMENT. With MF_CHIP the block is carved out from
+ * the end of a free block, so it gets allocated at the highest possible
+ * address. With MF_ZERO the payload is cleared, unless it was already. */
+static void *ar_malloc(arena_t *ar, size_t size, size_t align,
+                       MemFlags_t flags) {
   size_t reqsz = blksz(size);
+  size_t clrsz = size;
 
   vTaskSuspendAll();
 
-  word_t *bt = find_fit(ar, reqsz);
+  word_t *bt = find_aligned_fit(ar, reqsz, align);
   if (bt != NULL) {
-    bt_flags is_last = bt_get_islast(bt);
-    size_t memsz = reqsz - USEDBLK_SZ;
-    /* Mark found block as used. */
-    size_t sz = bt_size(bt);
+    size_t off = aligned_offset(bt, reqsz, align, flags & MF_CHIP);
+    /* Only free list links may be left in a cleared block. */
+    if (bt_get_zeroed(bt))
+      clrsz = off ? 0 : min(size, sizeof(node_t));
     n_remove(bt);
-    bt_make(bt, reqsz, USED | is_last);
-    /* Split free block if needed. */
-    word_t *next = bt_next(bt);
-    if (sz > reqsz) {
-      bt_make(next, sz - reqsz, FREE | is_last);
-      bt_clr_islast(bt);
-      memsz += USEDBLK_SZ;
-      n_insert(next);
-    } else if (!is_last) {
-      /* Nothing to split? Then previous block is not free anymore! */
-      bt_clr_prevfree(next);
-    }
-    ar_dec_free(ar, memsz);
+    bt = ar_carve(ar, bt, off, reqsz);
   }
 
   xTaskResumeAll();
 
+  if (bt != NULL && (flags & MF_ZERO)) {
+    bzero(bt_payload(bt), clrsz);
+    Atomic_Add_u32(&ZeroStats.saved, size - clrsz);
+  }
+
   /* Did we run out of memory? */
   void *ptr = bt ? bt_payload(bt) : NULL;
   debug("%s(%p, %lu) = %p", __func__, ar, size, ptr);
   return ptr;
 }
 
+/* Freed block up to that size gets cleared right away, if that keeps the block
+ * it is merged with cleared. Otherwise the whole block would have to be
+ * cleared again by MemIdle. */
+#define ZERO_EAGER 256
+
 static void ar_free(arena_t *ar, void *ptr) {
   debug("%s(%p, %p)", __func__, ar, ptr);
 
@@ -267,50 +515,67 @@ static void ar_free(arena_t *ar, void *ptr) {
 
   assert(bt_used(bt) && bt_has_canary(bt)); /* Is block free and has canary? */
 
-  /* Mark block as free. */
   size_t memsz = bt_size(bt) - USEDBLK_SZ;
   size_t sz = bt_size(bt);
-  bt_make(bt, sz, FREE | bt_get_flags(bt));
+  bt_flags is_last = bt_get_islast(bt);
+  word_t *prev = bt_get_prevfree(bt) ? bt_prev(bt) : NULL;
+  word_t *next = is_last ? NULL : bt_next(bt);
   debug("bt = %p (size: %u)", bt, sz);
 
-  word_t *next = bt_next(bt);
-  if (next) {
-    if (bt_free(next)) {
-      /* Coalesce with next block. */
-      n_remove(next);
-      sz += bt_size(next);
-      bt_make(bt, sz, FREE | bt_get_prevfree(bt) | bt_get_islast(next));
-      memsz += USEDBLK_SZ;
-    } else {
-      /* Mark next used block with prevfree flag. */
-      bt_set_prevfree(next);
-    }
+  if (next != NULL && !bt_free(next)) {
+    /* Mark next used block with prevfree flag. */
+    bt_set_prevfree(next);
+    next = NULL;
+  }
+
+  bt_flags zeroed = 0;
+  if ((prev || next) && sz <= ZERO_EAGER && (!prev || bt_get_zeroed(prev)) &&
+      (!next || bt_get_zeroed(next)))
+    zeroed = ZEROED;
+
+  /* Start of the area to clear if merged block is to remain zeroed. */
+  void *zstart = prev ? (void *)bt - sizeof(word_t) : ptr;
+  void *zend = bt_footer(bt);
+
+  if (next != NULL) {
+    /* Coalesce with next block. */
+    n_remove(next);
+    sz += bt_size(next);
+    is_last = bt_get_islast(next);
+    memsz += USEDBLK_SZ;
+    zend = bt_payload(next) + sizeof(node_t);
   }
 
-  /* Check if can coalesce with previous block. */
-  if (bt_get_prevfree(bt)) {
-    word_t *prev = bt_prev(bt);
+  if (prev != NULL) {
+    /* Coalesce with previous block. */
     n_remove(prev);
     sz += bt_size(prev);
-    bt_make(prev, sz, FREE | bt_get_islast(bt));
     memsz += USEDBLK_SZ;
     bt = prev;
   }
 
+  if (zeroed) {
+    bzero(zstart, zend - zstart);
+    ZeroStats.eager += zend - zstart;
+  }
+
+  bt_make(bt, sz, FREE | is_last | zeroed);
   ar->totalFree += memsz;
   n_insert(bt);
 
   xTaskResumeAll();
 }
 
+static MemReallocStats_t ReallocStats;
+
 static void *ar_realloc(arena_t *ar, void *old_ptr, size_t size) {
   void *new_ptr = NULL;
   word_t *bt = bt_fromptr(old_ptr);
   size_t reqsz = blksz(size);
   size_t sz = bt_size(bt);
 
-  if (reqsz == sz) {
-    /* Same size: nothing to do. */
+  if (reqsz == sz || (reqsz < sz && sz - reqsz < MINBLK)) {
+    /* Same size or cannot split off a free block: nothing to do. */
     return old_ptr;
   }
 
@@ -327,29 +592,62 @@ static void *ar_realloc(arena_t *ar, void *old_ptr, size_t size) {
   } else {
     /* Expand block */
     word_t *next = bt_next(bt);
-    if (next && bt_free(next)) {
+    if (!bt_get_islast(bt) && bt_free(next)) {
       /* Use next free block if it has enough space. */
       bt_flags is_last = bt_get_islast(next);
+      bt_flags zeroed = bt_get_zeroed(next);
       size_t nextsz = bt_size(next);
       if (sz + nextsz >= reqsz) {
         size_t memsz;
+        /* Do not leave a remainder too small to become a free block. */
+        if (sz + nextsz - reqsz < MINBLK)
+          reqsz = sz + nextsz;
         n_remove(next);
         bt_make(bt, reqsz, USED | bt_get_prevfree(bt));
         word_t *next = bt_next(bt);
         if (sz + nextsz > reqsz) {
-          bt_make(next, sz + nextsz - reqsz, FREE | is_last);
+          bt_make(next, sz + nextsz - reqsz, FREE | is_last | zeroed);
           memsz = reqsz - sz;
           n_insert(next);
         } else {
           memsz = nextsz - USEDBLK_SZ;
-          bt_clr_prevfree(next);
+          if (is_last)
+            bt_set_islast(bt);
+          else
+            bt_clr_prevfree(next);
         }
         ar_dec_free(ar, memsz);
         new_ptr = old_ptr;
       }
     }
+
+    if (new_ptr == NULL && bt_get_prevfree(bt)) {
+      /* Try to merge with previous free block (and next one if free). */
+      word_t *prev = bt_prev(bt);
+      size_t prevsz = bt_size(prev);
+      int nextfree = !bt_get_islast(bt) && bt_free(next);
+      size_t nextsz = nextfree ? bt_size(next) : 0;
+      bt_flags is_last = nextfree ? bt_get_islast(next) : bt_get_islast(bt);
+      if (prevsz + sz + nextsz >= reqsz) {
+        n_remove(prev);
+        if (nextfree)
+          n_remove(next);
+        /* Old block gets freed and coalesced with its neighbours. */
+        ar->totalFree += sz + (nextfree ? USEDBLK_SZ : 0);
+        bt_make(prev, prevsz + sz + nextsz, FREE | is_last);
+        if (!nextfree && !is_last)
+          bt_set_prevfree(next);
+        /* Payload is copied down before new tags overwrite it. */
+        memmove(bt_payload(prev), old_ptr, sz - USEDBLK_SZ);
+        new_ptr = bt_payload(ar_carve(ar, prev, 0, reqsz));
+        ReallocStats.slid++;
+      }
+    }
   }
 
+  if (new_ptr == old_ptr)
+    ReallocStats.inplace++;
+
   xTaskResumeAll();
 
   debug("%s(%p, %ld) = %p", __func__, old_ptr, size, new_ptr);
@@ -369,17 +667,21 @@ static void ar_check(arena_t *ar, int verbose) {
   word_t *prev = NULL;
   int prevfree = 0;
   unsigned freeMem = 0, dangling = 0;
+  unsigned usedBlks = 0, usedMem = 0;
 
   msg("--=[ all block list ]=---\n");
 
   for (; bt < ar->end; prev = bt, bt = bt_next(bt)) {
     int flag = !!bt_get_prevfree(bt);
     int is_last = !!bt_get_islast(bt);
-    msg("%p: [%c%c:%d] %c\n", bt, "FU"[bt_used(bt)], " P"[flag], bt_size(bt),
-        " *"[is_last]);
+    int zeroed = !!bt_get_zeroed(bt);
+    msg("%p: [%c%c%c:%d] %c\n", bt, "FU"[bt_used(bt)], " P"[flag], " Z"[zeroed],
+        bt_size(bt), " *"[is_last]);
     if (bt_free(bt)) {
       word_t *ft = bt_footer(bt);
       assert(*bt == *ft); /* Header and footer do not match? */
+      for (word_t *w = bt_payload(bt) + sizeof(node_t); zeroed && w < ft; w++)
+        assert(*w == 0); /* Block marked as cleared is dirty? */
       assert(!prevfree);  /* Free block not coalesced? */
       prevfree = 1;
       freeMem += bt_size(bt) - USEDBLK_SZ;
@@ -388,6 +690,8 @@ static void ar_check(arena_t *ar, int verbose) {
       assert(flag == prevfree);  /* PREVFREE flag mismatch? */
       assert(bt_has_canary(bt)); /* Canary damaged? */
       prevfree = 0;
+      usedBlks++;
+      usedMem += bt_size(bt);
     }
   }
 
@@ -396,17 +700,35 @@ static void ar_check(arena_t *ar, int verbose) {
 
   msg("--=[ free block list start ]=---\n");
 
-  for (node_t *n = n_next(head); n != head; n = n_next(n)) {
-    word_t *bt = bt_fromptr(n);
-    msg("%p: [%p, %p]\n", n, n_prev(n), n_next(n));
-    assert(bt_free(bt));
-    dangling--;
+  for (unsigned bin = 0; bin < NBINS; bin++) {
+    node_t *head = bin_head(ar, bin);
+    int empty = (n_next(head) == head);
+    assert(empty == !(ar->binmap & (1U << bin))); /* Bitmap out of sync? */
+    if (!empty)
+      msg("bin %d:\n", bin);
+    for (node_t *n = n_next(head); n != head; n = n_next(n)) {
+      word_t *bt = bt_fromptr(n);
+      msg("%p: [%p, %p] %d\n", n, n_prev(n), n_next(n), bt_size(bt));
+      assert(bt_free(bt));
+      assert(bin_index(bt_size(bt)) == bin); /* Block in wrong bin? */
+      dangling--;
+    }
   }
 
   msg("--=[ free block list end ]=---\n");
 
   assert(dangling == 0 && "Dangling free blocks!");
 
+  /* Boundary tags and canaries are the fixed cost of each used block. On top
+   * of that a block is rounded up to ALIGNMENT and must fit free list links
+   * once released, which sets the minimum block size. */
+  msg("--=[ overhead ]=---\n");
+  msg("alignment: %d, link size: %d, minimum block: %d\n", ALIGNMENT,
+      (int)sizeof(node_t), (int)blksz(1));
+  msg("used: %u blocks, %u bytes, %u bytes of tags (%u%%)\n", usedBlks,
+      usedMem, usedBlks * USEDBLK_SZ,
+      usedMem ? usedBlks * USEDBLK_SZ * 100 / usedMem : 0);
+
   xTaskResumeAll();
 }
 
@@ -414,116 +736,910 @@ static void ar_check(arena_t *ar, int verbose) {
 
 const MemRegion_t *MemRegions;
 
-static inline arena_t *arena(const MemRegion_t *mr) {
-  return (arena_t *)mr->mr_lower;
-}
+/* All arenas in order of memory regions passed by the boot loader. */
+static arena_t *Arenas;
 
 static int inside(void *ptr, arena_t *ar) {
   return ptr >= (void *)ar->start && ptr < (void *)ar->end;
 }
 
 static arena_t *arena_of(void *p) {
-  arena_t *ar = NULL;
-  for (const MemRegion_t *mr = MemRegions; mr->mr_upper; mr++) {
-    if (inside(p, arena(mr))) {
-      ar = arena(mr);
+  arena_t *ar;
+  for (ar = Arenas; ar != NULL; ar = ar->next)
+    if (inside(p, ar))
       break;
-    }
-  }
   assert(ar != NULL);
   return ar;
 }
 
-void *_pvPortMallocBelow(size_t xSize, uintptr_t xUpperAddr) {
+/* There's no real Amiga that has more than 2MiB of chip memory. */
+#define MEM_CHIP (1U << 21)
+/* Slow memory expansion is mapped in the trapdoor area. */
+#define MEM_SLOW_LOWER 0xC00000U
+#define MEM_SLOW_UPPER 0xDC0000U
+
+static const char *TierName[NTIERS] = {
+  [TIER_CHIP] = "chip", [TIER_SLOW] = "slow", [TIER_FAST] = "fast"};
+
+/* Tiers to try in order of preference. Each list is terminated by NTIERS. */
+static const uint8_t ChipOnly[] = {TIER_CHIP, NTIERS};
+static const uint8_t FastOnly[] = {TIER_FAST, NTIERS};
+static const uint8_t PreferFast[] = {TIER_FAST, TIER_SLOW, TIER_CHIP, NTIERS};
+
+typedef struct tierstat {
+  uint32_t allocs; /* number of blocks allocated in the tier */
+  uint32_t spills; /* ... of those that were meant to go to a faster tier */
+  uint32_t fails;  /* number of requests for the tier that failed */
+} tierstat_t;
+
+static tierstat_t TierStats[NTIERS];
+
+static inline tier_t mem_tier(uintptr_t addr) {
+  if (addr < MEM_CHIP)
+    return TIER_CHIP;
+  if (addr >= MEM_SLOW_LOWER && addr < MEM_SLOW_UPPER)
+    return TIER_SLOW;
+  return TIER_FAST;
+}
+
+static const uint8_t *tier_order(MemFlags_t flags) {
+  if (flags & MF_CHIP)
+    return ChipOnly;
+  if (flags & MF_FAST)
+    return FastOnly;
+  return PreferFast;
+}
+
+/* Chip memory is allocated top-down, so that long-lived DMA buffers do not
+ * fragment the low part of the region shared with CPU-only data. */
+static void *ar_malloc_tiers(size_t size, size_t align, MemFlags_t flags) {
+  const uint8_t *order = tier_order(flags);
   void *ptr;
-  for (const MemRegion_t *mr = MemRegions; mr->mr_upper; mr++) {
-    if ((uintptr_t)arena(mr) >= xUpperAddr)
+
+  for (const uint8_t *tier = order; *tier != NTIERS; tier++) {
+    for (arena_t *ar = Arenas; ar != NULL; ar = ar->next) {
+      if (ar->tier != *tier)
+        continue;
+      if ((ptr = ar_malloc(ar, size, align, flags))) {
+        Atomic_Increment_u32(&TierStats[*tier].allocs);
+        if (*tier != order[0])
+          Atomic_Increment_u32(&TierStats[*tier].spills);
+        return ptr;
+      }
+    }
+  }
+  return NULL;
+}
+
+/* --=[ heap profiler ]=----------------------------------------------------- */
+
+#if MEMPROF
+/* Each allocated block carries a record just before its canary that tells
+ * who requested it. Blocks that are freed (or cached) have tag set to MT_FREE,
+ * so live blocks can be told apart when walking the arenas. */
+typedef struct memrec {
+  void *caller; /* return address of MemAlloc & co. caller */
+  uint32_t tag; /* subsystem tag or MT_FREE */
+} memrec_t;
+
+#define MT_FREE (-1U)
+#define MEMREC_SZ sizeof(memrec_t)
+
+typedef struct memstat {
+  uint32_t live;    /* bytes in blocks allocated and not freed yet */
+  uint32_t chip;    /* the part of `live` that resides in chip memory */
+  uint32_t peak;    /* maximum recorded value of `live` */
+  uint32_t nlive;   /* number of blocks allocated and not freed yet */
+  uint32_t nallocs; /* number of allocations made so far */
+} memstat_t;
+
+static memstat_t MemStats[MT_COUNT];
+
+static inline memrec_t *bt_memrec(word_t *bt) {
+  return (memrec_t *)bt_footer(bt) - 1;
+}
+
+/* Records block owner. `nallocs` is not bumped for blocks that were only
+ * resized by MemRealloc. */
+static void *prof_record(void *ptr, MemTag_t tag, void *caller, int alloc) {
+  if (ptr == NULL)
+    return NULL;
+
+  if (tag >= MT_COUNT)
+    tag = MT_NONE;
+
+  word_t *bt = bt_fromptr(ptr);
+  memrec_t *rec = bt_memrec(bt);
+  rec->caller = caller;
+  rec->tag = tag;
+
+  memstat_t *ms = &MemStats[tag];
+  size_t sz = bt_size(bt);
+
+  taskENTER_CRITICAL();
+  ms->live += sz;
+  if (mem_tier((uintptr_t)ptr) == TIER_CHIP)
+    ms->chip += sz;
+  if (ms->live > ms->peak)
+    ms->peak = ms->live;
+  ms->nlive++;
+  if (alloc)
+    ms->nallocs++;
+  taskEXIT_CRITICAL();
+
+  return ptr;
+}
+
+static void *prof_alloc(void *ptr, MemTag_t tag, void *caller) {
+  return prof_record(ptr, tag, caller, 1);
+}
+
+static void *prof_move(void *ptr, MemTag_t tag, void *caller) {
+  return prof_record(ptr, tag, caller, 0);
+}
+
+static void prof_free(void *ptr) {
+  word_t *bt = bt_fromptr(ptr);
+  memrec_t *rec = bt_memrec(bt);
+
+  assert(rec->tag < MT_COUNT); /* Block record damaged or freed twice? */
+
+  memstat_t *ms = &MemStats[rec->tag];
+  size_t sz = bt_size(bt);
+
+  taskENTER_CRITICAL();
+  ms->live -= sz;
+  if (mem_tier((uintptr_t)ptr) == TIER_CHIP)
+    ms->chip -= sz;
+  ms->nlive--;
+  taskEXIT_CRITICAL();
+
+  rec->tag = MT_FREE;
+}
+
+static void *prof_caller(void *ptr) {
+  return bt_memrec(bt_fromptr(ptr))->caller;
+}
+
+static MemTag_t prof_tag(void *ptr) {
+  return bt_memrec(bt_fromptr(ptr))->tag;
+}
+#else
+#define MEMREC_SZ 0
+
+static inline void *prof_alloc(void *ptr, __unused MemTag_t tag,
+                               __unused void *caller) {
+  return ptr;
+}
+
+static inline void *prof_move(void *ptr, __unused MemTag_t tag,
+                              __unused void *caller) {
+  return ptr;
+}
+
+static inline void prof_free(__unused void *ptr) {
+}
+
+static inline void *prof_caller(__unused void *ptr) {
+  return NULL;
+}
+
+static inline MemTag_t prof_tag(__unused void *ptr) {
+  return MT_NONE;
+}
+#endif
+
+/* --=[ per-task cache ]=---------------------------------------------------- */
+
+/* Each task keeps a magazine of recently freed blocks for the smallest size
+ * classes, so most alloc/free pairs do not have to suspend the scheduler and
+ * search the arena. Cached blocks stay marked as used in their arena. Only the
+ * owner task modifies its magazine, hence no locking is needed. The owner sets
+ * `busy` for the duration of magazine operation, so that mag_drain, which runs
+ * with the scheduler suspended, can tell if the magazine is consistent.
+ *
+ * A block freed by a task other than the one that allocated it is accepted as
+ * any other block. If the magazine of the freeing task is full it falls back
+ * to the arena. Blocks cached that way are given back to arenas by mag_drain
+ * when an allocation is about to fail. The idle task frees stacks and TCBs of
+ * deleted tasks, but never allocates, so it does not get a magazine at all. */
+#define NMAGS 8 /* number of cached size classes */
+#define MAGSZ 4 /* blocks kept for each size class */
+
+typedef struct magazine {
+  struct magazine *next; /* next magazine on the list of all magazines */
+  volatile uint8_t busy; /* set by the owner while it uses the magazine */
+  uint8_t count[NMAGS];
+  void *blk[NMAGS][MAGSZ];
+} magazine_t;
+
+/* Magazines of all tasks, modified with the scheduler suspended. */
+static magazine_t *Magazines;
+
+static inline unsigned mag_index(size_t sz) {
+  return sz / ALIGNMENT - 1;
+}
+
+static magazine_t *mag_self(int create) {
+  /* Thread local storage is not available before the scheduler starts. */
+  if (xTaskGetSchedulerState() == taskSCHEDULER_NOT_STARTED)
+    return NULL;
+
+  magazine_t *mag = pvTaskGetThreadLocalStoragePointer(NULL, TLS_MEMCACHE);
+  if (mag == NULL && create) {
+    if (xTaskGetCurrentTaskHandle() == xTaskGetIdleTaskHandle())
+      return NULL;
+    mag = ar_malloc_tiers(sizeof(magazine_t) + MEMREC_SZ, ALIGNMENT, 0);
+    if ((mag = prof_alloc(mag, MT_KERNEL, __builtin_return_address(0)))) {
+      bzero(mag, sizeof(magazine_t));
+      vTaskSetThreadLocalStoragePointer(NULL, TLS_MEMCACHE, mag);
+      vTaskSuspendAll();
+      mag->next = Magazines;
+      Magazines = mag;
+      xTaskResumeAll();
+    }
+  }
+  return mag;
+}
+
+static inline void mag_enter(magazine_t *mag) {
+  mag->busy = 1;
+  __compiler_membar();
+}
+
+static inline void mag_leave(magazine_t *mag) {
+  __compiler_membar();
+  mag->busy = 0;
+}
+
+static int tier_ok(void *ptr, MemFlags_t flags) {
+  tier_t t = mem_tier((uintptr_t)ptr);
+  for (const uint8_t *tier = tier_order(flags); *tier != NTIERS; tier++)
+    if (*tier == t)
+      return 1;
+  return 0;
+}
+
+static void *mag_alloc(size_t size, size_t align, MemFlags_t flags) {
+  unsigned i = mag_index(blksz(size));
+  if (i >= NMAGS)
+    return NULL;
+
+  magazine_t *mag = mag_self(0);
+  if (mag == NULL)
+    return NULL;
+
+  void *ptr = NULL;
+  mag_enter(mag);
+  if (mag->count[i] > 0) {
+    /* Cached block may reside in a memory tier that was not requested. */
+    ptr = mag->blk[i][mag->count[i] - 1];
+    if (tier_ok(ptr, flags) && !((uintptr_t)ptr & (align - 1)))
+      mag->count[i]--;
+    else
+      ptr = NULL;
+  }
+  mag_leave(mag);
+
+  debug("%s(%lu) = %p", __func__, size, ptr);
+  return ptr;
+}
+
+static int mag_free(void *ptr) {
+  word_t *bt = bt_fromptr(ptr);
+  unsigned i = mag_index(bt_size(bt));
+  if (i >= NMAGS)
+    return 0;
+
+  assert(bt_used(bt) && bt_has_canary(bt)); /* Is block free and has canary? */
+
+  magazine_t *mag = mag_self(1);
+  if (mag == NULL)
+    return 0;
+
+  int cached = 0;
+  mag_enter(mag);
+  if (mag->count[i] < MAGSZ) {
+    for (unsigned j = 0; j < mag->count[i]; j++)
+      assert(mag->blk[i][j] != ptr); /* Block freed twice? */
+    mag->blk[i][mag->count[i]++] = ptr;
+    cached = 1;
+  }
+  mag_leave(mag);
+
+  debug("%s(%p) = %d", __func__, ptr, cached);
+  return cached;
+}
+
+/* Returns non-zero if any block was given back to the arena. */
+static int mag_flush(magazine_t *mag) {
+  int flushed = 0;
+  if (mag == NULL)
+    return 0;
+  for (unsigned i = 0; i < NMAGS; i++) {
+    while (mag->count[i] > 0) {
+      void *ptr = mag->blk[i][--mag->count[i]];
+      ar_free(arena_of(ptr), ptr);
+      flushed = 1;
+    }
+  }
+  return flushed;
+}
+
+/* Gives blocks cached by all tasks back to arenas. A magazine of a task that
+ * was preempted in the middle of magazine operation is left alone. Returns
+ * non-zero if any block was given back. */
+static int mag_drain(void) {
+  int flushed = 0;
+  vTaskSuspendAll();
+  for (magazine_t *mag = Magazines; mag != NULL; mag = mag->next)
+    if (!mag->busy)
+      flushed |= mag_flush(mag);
+  xTaskResumeAll();
+  return flushed;
+}
+
+void vPortCleanUpTCB(void *pxTCB) {
+  magazine_t *mag = pvTaskGetThreadLocalStoragePointer(pxTCB, TLS_MEMCACHE);
+  if (mag != NULL) {
+    vTaskSuspendAll();
+    for (magazine_t **magp = &Magazines; *magp != NULL; magp = &(*magp)->next) {
+      if (*magp == mag) {
+        *magp = mag->next;
+        break;
+      }
+    }
+    xTaskResumeAll();
+    mag_flush(mag);
+    prof_free(mag);
+    ar_free(arena_of(mag), mag);
+  }
+}
+
+/* --=[ allocation trace ]=------------------------------------------------- */
+
+#if MEMTRACE
+#define NTRACE 1024 /* number of records kept, must be a power of two */
+
+static MemTraceRec_t Trace[NTRACE];
+static uint32_t TraceHead; /* number of records written since boot */
+static uint32_t TraceTail; /* number of records dumped or dropped */
+static int TracePaused;
+
+static void trace(MemTraceOp_t op, MemFlags_t flags, size_t size, void *ptr,
+                  uintptr_t arg) {
+  if (TracePaused)
+    return;
+  MemTraceRec_t *rec = &Trace[Atomic_Increment_u32(&TraceHead) % NTRACE];
+  rec->tick = xTaskGetTickCount();
+  rec->op = op;
+  rec->flags = flags;
+  rec->size = size;
+  rec->ptr = (uintptr_t)ptr;
+  rec->arg = arg;
+}
+
+void MemTraceDump(File_t *f) {
+  /* Calls made while the trace is written out are not recorded. */
+  TracePaused = 1;
+
+  uint32_t head = TraceHead;
+  uint32_t count = min(head - TraceTail, (uint32_t)NTRACE);
+  MemTraceHdr_t hdr = {.magic = MEMTRACE_MAGIC,
+                       .count = count,
+                       .dropped = head - TraceTail - count};
+  FileWrite(f, &hdr, sizeof(hdr), NULL);
+
+  /* Oldest records may wrap around the end of the ring buffer. */
+  uint32_t first = (head - count) % NTRACE;
+  uint32_t n = min(count, NTRACE - first);
+  FileWrite(f, &Trace[first], n * sizeof(MemTraceRec_t), NULL);
+  FileWrite(f, &Trace[0], (count - n) * sizeof(MemTraceRec_t), NULL);
+
+  TraceTail = head;
+  TracePaused = 0;
+}
+
+void MemGetTraceStats(MemTraceStats_t *st) {
+  st->records = TraceHead;
+  st->walkmax = WalkMax;
+}
+#else
+#define trace(op, flags, size, ptr, arg)
+
+void MemTraceDump(File_t *f) {
+  MemTraceHdr_t hdr = {.magic = MEMTRACE_MAGIC, .count = 0, .dropped = 0};
+  FileWrite(f, &hdr, sizeof(hdr), NULL);
+}
+
+void MemGetTraceStats(MemTraceStats_t *st) {
+  st->records = 0;
+  st->walkmax = 0;
+}
+#endif
+
+/* --=[ memory pressure ]=-------------------------------------------------- */
+
+/* Shrinkers sorted by descending priority. */
+static MemShrinker_t *Shrinkers;
+/* Pressure level of fast (including slow) and chip memory. */
+static MemPressure_t Pressure[2];
+/* Set while shrinkers are running, so they cannot trigger reclaim. */
+static int Reclaiming;
+
+void AddMemShrinker(MemShrinker_t *ms) {
+  vTaskSuspendAll();
+  MemShrinker_t **msp = &Shrinkers;
+  while (*msp != NULL && (*msp)->priority >= ms->priority)
+    msp = &(*msp)->next;
+  ms->next = *msp;
+  *msp = ms;
+  xTaskResumeAll();
+}
+
+void RemMemShrinker(MemShrinker_t *ms) {
+  vTaskSuspendAll();
+  for (MemShrinker_t **msp = &Shrinkers; *msp != NULL; msp = &(*msp)->next) {
+    if (*msp == ms) {
+      *msp = ms->next;
+      break;
+    }
+  }
+  xTaskResumeAll();
+}
+
+/* Returns bitmask of Pressure entries that correspond to `flags`. */
+static unsigned pressure_mask(MemFlags_t flags) {
+  if (flags & MF_CHIP)
+    return 2;
+  if (flags & MF_FAST)
+    return 1;
+  return 3;
+}
+
+MemPressure_t MemPressure(MemFlags_t flags) {
+  unsigned mask = pressure_mask(flags);
+  MemPressure_t level = MP_NONE;
+
+  for (unsigned chip = 0; chip < 2; chip++) {
+    if (!(mask & (1U << chip)) || Pressure[chip] == MP_NONE)
       continue;
-    if ((ptr = ar_malloc(arena(mr), xSize)))
-      return ptr;
+    size_t size = 0, free = 0;
+    for (arena_t *ar = Arenas; ar != NULL; ar = ar->next) {
+      if ((ar->tier == TIER_CHIP) != chip)
+        continue;
+      size += (void *)ar->end - (void *)ar->start;
+      free += ar->totalFree;
+    }
+    /* Pressure is gone once there's an eighth of memory free again. */
+    if (free >= size / 8)
+      Pressure[chip] = MP_NONE;
+    level = max(level, Pressure[chip]);
+  }
+
+  return level;
+}
+
+/* Asks shrinkers to release memory until the allocation succeeds. */
+static void *mem_reclaim(size_t size, size_t align, MemFlags_t flags,
+                         MemPressure_t level) {
+  unsigned mask = pressure_mask(flags);
+  void *ptr = NULL;
+
+  vTaskSuspendAll();
+
+  if (!Reclaiming) {
+    Reclaiming = 1;
+    for (unsigned chip = 0; chip < 2; chip++)
+      if (mask & (1U << chip))
+        Pressure[chip] = max(Pressure[chip], level);
+    for (MemShrinker_t *ms = Shrinkers; ms != NULL && ptr == NULL;
+         ms = ms->next) {
+      if (ms->shrink(ms->data, flags & (MF_CHIP | MF_FAST), level, size))
+        ptr = ar_malloc_tiers(size, align, flags);
+    }
+    Reclaiming = 0;
   }
 
+  xTaskResumeAll();
+
+  return ptr;
+}
+
+static void *mem_alloc(size_t size, size_t align, MemFlags_t flags) {
+  void *ptr;
+
+  if ((ptr = mag_alloc(size, align, flags))) {
+    /* Cached blocks are never known to be cleared. */
+    if (flags & MF_ZERO)
+      bzero(ptr, size);
+    return ptr;
+  }
+
+  if ((ptr = ar_malloc_tiers(size, align, flags)))
+    return ptr;
+
+  /* Blocks cached by tasks may be just enough to satisfy the request. */
+  if (mag_drain() && (ptr = ar_malloc_tiers(size, align, flags)))
+    return ptr;
+
+  /* Let caches give memory back, gently at first. */
+  if ((ptr = mem_reclaim(size, align, flags, MP_LOW)))
+    return ptr;
+  if ((ptr = mem_reclaim(size, align, flags, MP_CRITICAL)))
+    return ptr;
+
+  Atomic_Increment_u32(&TierStats[tier_order(flags)[0]].fails);
+
 #if (configUSE_MALLOC_FAILED_HOOK == 1)
-  extern void vApplicationMallocFailedHook(void);
-  vApplicationMallocFailedHook();
+  if (!(flags & MF_TRY)) {
+    extern void vApplicationMallocFailedHook(void);
+    vApplicationMallocFailedHook();
+  }
 #endif
   return NULL;
 }
 
-/* There's no real Amiga that has more than 2MiB of chip memory. */
-#define MEM_ANY (-1U)
-#define MEM_CHIP (1U << 21)
-
 void *pvPortMalloc(size_t xSize) {
-  return _pvPortMallocBelow(xSize, MEM_ANY);
+  void *ptr = mem_alloc(xSize + MEMREC_SZ, ALIGNMENT, 0);
+  trace(MTR_ALLOC, MF_TAG(MT_RTOS), xSize, ptr, ALIGNMENT);
+  return prof_alloc(ptr, MT_RTOS, __builtin_return_address(0));
 }
 
 void *MemAlloc(size_t xSize, MemFlags_t flags) {
-  void *ptr = _pvPortMallocBelow(xSize, (flags & MF_CHIP) ? MEM_CHIP : MEM_ANY);
-  if (ptr && (flags & MF_ZERO))
-    bzero(ptr, xSize);
-  return ptr;
+  void *ptr = mem_alloc(xSize + MEMREC_SZ, ALIGNMENT, flags);
+  trace(MTR_ALLOC, flags, xSize, ptr, ALIGNMENT);
+  return prof_alloc(ptr, MF_TAGOF(flags), __builtin_return_address(0));
 }
 
-void vPortFree(void *p) {
-  if (p != NULL)
+void *MemAllocAligned(size_t xSize, size_t align, MemFlags_t flags) {
+  assert((align & (align - 1)) == 0); /* Alignment must be a power of two! */
+  if (align < ALIGNMENT)
+    align = ALIGNMENT;
+  void *ptr = mem_alloc(xSize + MEMREC_SZ, align, flags);
+  trace(MTR_ALLOC, flags, xSize, ptr, align);
+  return prof_alloc(ptr, MF_TAGOF(flags), __builtin_return_address(0));
+}
+
+static void mem_free(void *p) {
+  if (p == NULL)
+    return;
+  prof_free(p);
+  /* Memory released by shrinkers must be visible to mem_reclaim. */
+  if (Reclaiming || !mag_free(p))
     ar_free(arena_of(p), p);
 }
 
+void vPortFree(void *p) {
+  trace(MTR_FREE, 0, 0, p, 0);
+  mem_free(p);
+}
+
 __strong_alias(MemFree, vPortFree);
 
-void *MemRealloc(void *old_ptr, size_t size) {
+static void *mem_realloc(void *old_ptr, size_t size, void *caller) {
   void *new_ptr;
 
   if (size == 0) {
-    vPortFree(old_ptr);
+    mem_free(old_ptr);
     return NULL;
   }
 
   if (old_ptr == NULL)
-    return pvPortMalloc(size);
+    return prof_alloc(mem_alloc(size + MEMREC_SZ, ALIGNMENT, 0), MT_NONE,
+                      caller);
 
-  if ((new_ptr = ar_realloc(arena_of(old_ptr), old_ptr, size)))
-    return new_ptr;
+  /* Record will be moved to the end of reallocated block. */
+  MemTag_t tag = prof_tag(old_ptr);
+  caller = prof_caller(old_ptr);
+  prof_free(old_ptr);
 
-  /* Run out of options - need to move block physically. */
-  if ((new_ptr = pvPortMalloc(size))) {
+  if ((new_ptr = ar_realloc(arena_of(old_ptr), old_ptr, size + MEMREC_SZ)))
+    return prof_move(new_ptr, tag, caller);
+
+  /* Run out of options - need to move block physically. We do not know if
+   * the block has to be accessible by chipset, so keep it in chip memory. */
+  MemFlags_t flags = 0;
+  if (mem_tier((uintptr_t)old_ptr) == TIER_CHIP)
+    flags = MF_CHIP;
+
+  if ((new_ptr = mem_alloc(size + MEMREC_SZ, ALIGNMENT, flags))) {
     word_t *bt = bt_fromptr(old_ptr);
     debug("%s(%p, %ld) = %p", __func__, old_ptr, size, new_ptr);
     memcpy(new_ptr, old_ptr, bt_size(bt) - sizeof(word_t));
-    vPortFree(old_ptr);
-    return new_ptr;
+    Atomic_Increment_u32(&ReallocStats.moved);
+    if (!mag_free(old_ptr))
+      ar_free(arena_of(old_ptr), old_ptr);
+    return prof_move(new_ptr, tag, caller);
   }
 
+  prof_move(old_ptr, tag, caller);
   return NULL;
 }
 
+void *MemRealloc(void *old_ptr, size_t size) {
+  void *new_ptr = mem_realloc(old_ptr, size, __builtin_return_address(0));
+  trace(MTR_REALLOC, 0, size, new_ptr, (uintptr_t)old_ptr);
+  return new_ptr;
+}
+
 void MemCheck(int verbose) {
-  for (const MemRegion_t *mr = MemRegions; mr->mr_upper; mr++)
-    ar_check(arena(mr), verbose);
+  for (arena_t *ar = Arenas; ar != NULL; ar = ar->next)
+    ar_check(ar, verbose);
+}
+
+/* Returns payload size of the largest free block in the arena. */
+static size_t ar_largest(arena_t *ar) {
+  size_t largest = 0;
+
+  vTaskSuspendAll();
+
+  if (ar->binmap) {
+    unsigned bin = NBINS - 1;
+    while (!(ar->binmap & (1U << bin)))
+      bin--;
+    node_t *head = bin_head(ar, bin);
+    for (node_t *n = n_next(head); n != head; n = n_next(n))
+      largest = max(largest, (size_t)bt_size(bt_fromptr(n)));
+  }
+
+  xTaskResumeAll();
+
+  return largest ? largest - USEDBLK_SZ - MEMREC_SZ : 0;
+}
+
+size_t MemAvail(MemFlags_t flags) {
+  const uint8_t *order = tier_order(flags);
+  size_t sum = 0;
+  for (arena_t *ar = Arenas; ar != NULL; ar = ar->next) {
+    for (const uint8_t *tier = order; *tier != NTIERS; tier++) {
+      if (ar->tier != *tier)
+        continue;
+      if (flags & MF_LARGEST)
+        sum = max(sum, ar_largest(ar));
+      else
+        sum += ar->totalFree;
+    }
+  }
+  return sum;
+}
+
+void MemGetReallocStats(MemReallocStats_t *st) {
+  vTaskSuspendAll();
+  *st = ReallocStats;
+  xTaskResumeAll();
+}
+
+/* --=[ background clearing ]=----------------------------------------------- */
+
+/* Bytes cleared by single MemIdle call. It bounds the time the scheduler is
+ * kept suspended. */
+#define ZERO_CHUNK 512U
+
+static size_t ZeroDone; /* bytes of ZeroBlk cleared so far */
+
+/* Returns free block that is not known to be cleared, larger ones first. */
+static word_t *ar_dirty(arena_t *ar) {
+  for (int bin = NBINS - 1; bin >= 0; bin--) {
+    if (!(ar->binmap & (1U << bin)))
+      continue;
+    node_t *head = bin_head(ar, bin);
+    for (node_t *n = n_next(head); n != head; n = n_next(n)) {
+      word_t *bt = bt_fromptr(n);
+      if (!bt_get_zeroed(bt))
+        return bt;
+    }
+  }
+  return NULL;
+}
+
+void MemIdle(void) {
+  if (!ZeroPending)
+    return;
+
+  vTaskSuspendAll();
+
+  if (ZeroBlk == NULL) {
+    for (arena_t *ar = Arenas; ar != NULL && ZeroBlk == NULL; ar = ar->next)
+      ZeroBlk = ar_dirty(ar);
+    ZeroPending = (ZeroBlk != NULL);
+    ZeroDone = 0;
+  }
+
+  if (ZeroBlk != NULL) {
+    void *start = bt_payload(ZeroBlk) + sizeof(node_t);
+    size_t left = (void *)bt_footer(ZeroBlk) - start - ZeroDone;
+    size_t n = min(left, ZERO_CHUNK);
+    bzero(start + ZeroDone, n);
+    ZeroDone += n;
+    ZeroStats.cleared += n;
+    if (n == left) {
+      bt_set_zeroed(ZeroBlk);
+      ZeroBlk = NULL;
+    }
+  }
+
+  xTaskResumeAll();
+}
+
+void MemGetZeroStats(MemZeroStats_t *st) {
+  vTaskSuspendAll();
+  *st = ZeroStats;
+  xTaskResumeAll();
 }
 
 size_t xPortGetFreeHeapSize(void) {
   size_t sum = 0;
-  for (const MemRegion_t *mr = MemRegions; mr->mr_upper; mr++)
-    sum += arena(mr)->totalFree;
+  for (arena_t *ar = Arenas; ar != NULL; ar = ar->next)
+    sum += ar->totalFree;
   return sum;
 }
 
 size_t xPortGetMinimumEverFreeHeapSize(void) {
   size_t sum = 0;
-  for (const MemRegion_t *mr = MemRegions; mr->mr_upper; mr++)
-    sum += arena(mr)->minFree;
+  for (arena_t *ar = Arenas; ar != NULL; ar = ar->next)
+    sum += ar->minFree;
   return sum;
 }
 
+#if MEMPROF
+static const char *MemTagName[MT_COUNT] = {
+  [MT_NONE] = "none",     [MT_RTOS] = "rtos",     [MT_KERNEL] = "kernel",
+  [MT_PROC] = "proc",     [MT_DRIVER] = "driver", [MT_DISPLAY] = "display",
+  [MT_FLOPPY] = "floppy", [MT_TTY] = "tty",
+};
+
+#define NCALLSITES 16
+
+typedef struct callsite {
+  void *caller;
+  uint32_t tag;
+  uint32_t bytes;
+  uint32_t count;
+} callsite_t;
+
+/* Aggregates live blocks by call site. Returns the number of call sites found.
+ * Blocks that do not fit into `cs` table are accounted in `other`. */
+static unsigned prof_callsites(callsite_t *cs, callsite_t *other) {
+  unsigned n = 0;
+
+  vTaskSuspendAll();
+
+  for (arena_t *ar = Arenas; ar != NULL; ar = ar->next) {
+    for (word_t *bt = ar->start; bt < ar->end; bt = bt_next(bt)) {
+      if (bt_free(bt))
+        continue;
+      memrec_t *rec = bt_memrec(bt);
+      if (rec->tag >= MT_COUNT)
+        continue;
+      callsite_t *c = other;
+      for (unsigned i = 0; i < n; i++) {
+        if (cs[i].caller == rec->caller && cs[i].tag == rec->tag) {
+          c = &cs[i];
+          break;
+        }
+      }
+      if (c == other && n < NCALLSITES) {
+        c = &cs[n++];
+        c->caller = rec->caller;
+        c->tag = rec->tag;
+      }
+      c->bytes += bt_size(bt);
+      c->count++;
+    }
+  }
+
+  xTaskResumeAll();
+
+  /* Sort call sites by number of bytes in descending order. */
+  for (unsigned i = 1; i < n; i++) {
+    callsite_t c = cs[i];
+    unsigned j = i;
+    for (; j > 0 && cs[j - 1].bytes < c.bytes; j--)
+      cs[j] = cs[j - 1];
+    cs[j] = c;
+  }
+
+  return n;
+}
+
+static void prof_dump(File_t *f) {
+  memstat_t ms[MT_COUNT];
+  uint8_t order[MT_COUNT];
+
+  taskENTER_CRITICAL();
+  memcpy(ms, MemStats, sizeof(MemStats));
+  taskEXIT_CRITICAL();
+
+  /* Sort tags by number of live bytes in descending order. */
+  for (unsigned i = 0; i < MT_COUNT; i++) {
+    unsigned j = i;
+    for (; j > 0 && ms[order[j - 1]].live < ms[i].live; j--)
+      order[j] = order[j - 1];
+    order[j] = i;
+  }
+
+  FilePrintf(f, "%-8s %8s %8s %8s %6s %8s\n", "tag", "live", "chip", "peak",
+             "blocks", "allocs");
+  for (unsigned i = 0; i < MT_COUNT; i++) {
+    memstat_t *m = &ms[order[i]];
+    FilePrintf(f, "%-8s %8u %8u %8u %6u %8u\n", MemTagName[order[i]], m->live,
+               m->chip, m->peak, m->nlive, m->nallocs);
+  }
+
+  callsite_t cs[NCALLSITES], other;
+  bzero(cs, sizeof(cs));
+  bzero(&other, sizeof(other));
+  unsigned n = prof_callsites(cs, &other);
+
+  FilePrintf(f, "%-10s %-8s %8s %6s\n", "caller", "tag", "live", "blocks");
+  for (unsigned i = 0; i < n; i++)
+    FilePrintf(f, "%10p %-8s %8u %6u\n", cs[i].caller, MemTagName[cs[i].tag],
+               cs[i].bytes, cs[i].count);
+  if (other.count)
+    FilePrintf(f, "%-10s %-8s %8u %6u\n", "(other)", "", other.bytes,
+               other.count);
+}
+#endif
+
+void MemDumpStats(File_t *f) {
+  FilePrintf(f, "%-21s %4s %8s %8s %8s\n", "region", "tier", "size", "free",
+             "minfree");
+  for (arena_t *ar = Arenas; ar != NULL; ar = ar->next) {
+    FilePrintf(f, "%p-%p %4s %8u %8u %8u\n", ar->start, ar->end,
+               TierName[ar->tier], (void *)ar->end - (void *)ar->start,
+               ar->totalFree, ar->minFree);
+  }
+
+  FilePrintf(f, "%-4s %8s %8s %8s %8s %8s %6s\n", "tier", "size", "free",
+             "minfree", "allocs", "spills", "fails");
+  for (tier_t t = 0; t < NTIERS; t++) {
+    size_t size = 0, free = 0, minFree = 0;
+    for (arena_t *ar = Arenas; ar != NULL; ar = ar->next) {
+      if (ar->tier != t)
+        continue;
+      size += (void *)ar->end - (void *)ar->start;
+      free += ar->totalFree;
+      minFree += ar->minFree;
+    }
+    tierstat_t *ts = &TierStats[t];
+    FilePrintf(f, "%-4s %8u %8u %8u %8u %8u %6u\n", TierName[t], size, free,
+               minFree, ts->allocs, ts->spills, ts->fails);
+  }
+
+  MemZeroStats_t zs;
+  MemGetZeroStats(&zs);
+  FilePrintf(f, "zero: saved %u, cleared %u, eager %u\n", zs.saved, zs.cleared,
+             zs.eager);
+#if MEMPROF
+  prof_dump(f);
+#endif
+}
+
 void vPortDefineMemoryRegions(MemRegion_t *aMemRegions) {
   MemRegions = aMemRegions;
 
+  arena_t **tailp = &Arenas;
+
   for (MemRegion_t *mr = aMemRegions; mr->mr_upper; mr++) {
     /* align upper and lower addresses */
     mr->mr_lower = roundup(mr->mr_lower, ALIGNMENT);
     mr->mr_upper = rounddown(mr->mr_upper, ALIGNMENT) - sizeof(word_t);
-    ar_init(arena(mr), (void *)mr->mr_upper);
+
+    /* Split region into arenas of at most ARENA_MAXSZ bytes. A leftover that
+     * is too small to hold an arena with a single block is skipped. */
+    uintptr_t lower = mr->mr_lower;
+    while (lower + sizeof(arena_t) + 2 * ALIGNMENT <= mr->mr_upper) {
+      uintptr_t upper = mr->mr_upper;
+      if (upper - lower > ARENA_MAXSZ)
+        upper = lower + ARENA_MAXSZ - sizeof(word_t);
+      arena_t *ar = (arena_t *)lower;
+      ar_init(ar, (void *)upper);
+      ar->tier = mem_tier(lower);
+      ar->next = NULL;
+      *tailp = ar;
+      tailp = &ar->next;
+      lower = upper + sizeof(word_t);
+    }
   }
 }
@@ -0,0 +1,95 @@
+#include <FreeRTOS/FreeRTOS.h>
+#include <FreeRTOS/task.h>
+
+#include <mempool.h>
+#include <strings.h>
+
+#define DEBUG 0
+#include <debug.h>
+
+struct MemSlab {
+  MemSlab_t *next;
+  uint32_t pad;   /* keep objects aligned to 8 bytes */
+  uint8_t data[]; /* `count` objects of `objsize` bytes */
+};
+
+/* Free objects store pointer to next free object in their first word. */
+static inline void *ObjNext(void *obj) {
+  return *(void **)obj;
+}
+
+static inline void ObjSetNext(void *obj, void *next) {
+  *(void **)obj = next;
+}
+
+MemPool_t *MemPoolCreate(size_t objsize, size_t count, MemFlags_t flags) {
+  MemPool_t *mp = MemAlloc(sizeof(MemPool_t), MF_TAG(MT_KERNEL));
+  if (mp == NULL)
+    return NULL;
+  Assert(count > 0);
+  *mp = MEMPOOL(objsize, count, flags);
+  return mp;
+}
+
+void MemPoolDestroy(MemPool_t *mp) {
+  MemSlab_t *next;
+  for (MemSlab_t *slab = mp->slabs; slab; slab = next) {
+    next = slab->next;
+    MemFree(slab);
+  }
+  MemFree(mp);
+}
+
+/* Allocate a slab, thread all its objects but first one onto a list and put
+ * them on pool's free list. Returns the first object. */
+static void *MemPoolGrow(MemPool_t *mp) {
+  size_t objsize = mp->objsize;
+  MemSlab_t *slab =
+    MemAlloc(sizeof(MemSlab_t) + objsize * mp->count, mp->flags & ~MF_ZERO);
+  if (slab == NULL)
+    return NULL;
+
+  void *first = slab->data;
+  void *last = first + objsize * (mp->count - 1);
+
+  /* Slab is not visible to other tasks yet, so no need to lock it. */
+  for (void *obj = first; obj < last; obj += objsize)
+    ObjSetNext(obj, obj + objsize);
+
+  DLOG("MemPool: new slab %p (%d x %d bytes)\n", slab, mp->count, objsize);
+
+  taskENTER_CRITICAL();
+  slab->next = mp->slabs;
+  mp->slabs = slab;
+  ObjSetNext(last, mp->freelst);
+  mp->freelst = ObjNext(first);
+  taskEXIT_CRITICAL();
+
+  return first;
+}
+
+void *MemPoolAlloc(MemPool_t *mp) {
+  void *obj;
+
+  taskENTER_CRITICAL();
+  if ((obj = mp->freelst))
+    mp->freelst = ObjNext(obj);
+  taskEXIT_CRITICAL();
+
+  if (obj == NULL && !(obj = MemPoolGrow(mp)))
+    return NULL;
+
+  if (mp->flags & MF_ZERO)
+    bzero(obj, mp->objsize);
+  return obj;
+}
+
+void MemPoolFree(MemPool_t *mp, void *ptr) {
+  if (ptr == NULL)
+    return;
+
+  taskENTER_CRITICAL();
+  ObjSetNext(ptr, mp->freelst);
+  mp->freelst = ptr;
+  taskEXIT_CRITICAL();
+}
@@ -1,10 +1,10 @@
 #include <FreeRTOS/FreeRTOS.h>
 #include <FreeRTOS/task.h>
-#include <FreeRTOS/queue.h>
+#include <FreeRTOS/semphr.h>
 
 #include <msgport.h>
 #include <notify.h>
-#include <memory.h>
+#include <mempool.h>
 #include <sys/errno.h>
 
 #define DEBUG 0
@@ -12,47 +12,93 @@
 
 struct MsgPort {
   TaskHandle_t owner;
-  QueueHandle_t queue;
+  SemaphoreHandle_t slots;   /* counts free slots for messages */
+  TAILQ_HEAD(, Msg) msglist; /* pending messages in order of arrival */
 };
 
-MsgPort_t *MsgPortCreate(TaskHandle_t owner) {
-  MsgPort_t *mp = MemAlloc(sizeof(MsgPort_t), MF_ZERO);
-  Assert(owner != NULL);
+MEMPOOL_DEFINE(MsgPortPool, sizeof(MsgPort_t), 8, MF_ZERO | MF_TAG(MT_KERNEL));
+
+MsgPort_t *MsgPortCreate(TaskHandle_t owner, size_t depth) {
+  MsgPort_t *mp = MemPoolAlloc(MsgPortPool);
+  Assert(owner != NULL && depth > 0);
   mp->owner = owner;
-  mp->queue = xQueueCreate(1, sizeof(Msg_t *));
+  mp->slots = xSemaphoreCreateCounting(depth, depth);
+  TAILQ_INIT(&mp->msglist);
   return mp;
 }
 
 void MsgPortDelete(MsgPort_t *mp) {
-  vQueueDelete(mp->queue);
-  MemFree(mp);
+  Assert(TAILQ_EMPTY(&mp->msglist));
+  vSemaphoreDelete(mp->slots);
+  MemPoolFree(MsgPortPool, mp);
 }
 
-void DoMsg(MsgPort_t *mp, Msg_t *msg) {
+/* Slot for the message must be taken already. */
+static void EnqueueMsg(MsgPort_t *mp, Msg_t *msg) {
   msg->task = xTaskGetCurrentTaskHandle();
-  DLOG("DoMsg: send message %x!\n", msg);
-  xQueueSend(mp->queue, &msg, portMAX_DELAY);
+  DLOG("PutMsg: send message %x!\n", msg);
+  vTaskSuspendAll();
+  TAILQ_INSERT_TAIL(&mp->msglist, msg, node);
+  xTaskResumeAll();
   NotifySend(mp->owner, NB_MSGPORT);
-  DLOG("DoMsg: wakeup owner %x!\n", mp->owner);
-  (void)NotifyWait(NB_MSGPORT, portMAX_DELAY);
+  DLOG("PutMsg: wakeup owner %x!\n", mp->owner);
+}
+
+int PutMsg(MsgPort_t *mp, Msg_t *msg) {
+  if (!xSemaphoreTake(mp->slots, 0))
+    return EAGAIN;
+  EnqueueMsg(mp, msg);
+  return 0;
+}
+
+void WaitMsg(Msg_t *msg) {
+  /* Notifications for other messages may wake us up as well. */
+  while (!CheckMsg(msg))
+    (void)NotifyWait(NB_MSGPORT, portMAX_DELAY);
+}
+
+void DoMsg(MsgPort_t *mp, Msg_t *msg) {
+  xSemaphoreTake(mp->slots, portMAX_DELAY);
+  EnqueueMsg(mp, msg);
+  WaitMsg(msg);
 }
 
 void *GetMsgData(MsgPort_t *mp) {
-  Msg_t *msg = NULL;
-  xQueuePeek(mp->queue, &msg, 0);
+  Msg_t *msg = NextMsg(mp, NULL);
   if (msg == NULL)
     return NULL;
   DLOG("GetMsg: message at %x!\n", msg);
   return msg->data;
 }
 
-void ReplyMsg(MsgPort_t *mp) {
-  Msg_t *msg;
+Msg_t *NextMsg(MsgPort_t *mp, Msg_t *msg) {
   vTaskSuspendAll();
-  DLOG("ReplyMsg: wakeup sender %x!\n", msg->task);
-  xQueueReceive(mp->queue, &msg, 0);
+  msg = msg ? TAILQ_NEXT(msg, node) : TAILQ_FIRST(&mp->msglist);
+  xTaskResumeAll();
+  return msg;
+}
+
+static void DequeueMsg(MsgPort_t *mp, Msg_t *msg, bool notify) {
   Assert(msg != NULL);
-  NotifySend(msg->task, NB_MSGPORT);
+  vTaskSuspendAll();
+  TAILQ_REMOVE(&mp->msglist, msg, node);
+  if (notify) {
+    DLOG("ReplyMsg: wakeup sender %x!\n", msg->task);
+    NotifySend(msg->task, NB_MSGPORT);
+  }
   msg->task = NULL;
   xTaskResumeAll();
+  xSemaphoreGive(mp->slots);
+}
+
+void ReplyToMsg(MsgPort_t *mp, Msg_t *msg) {
+  DequeueMsg(mp, msg, true);
+}
+
+void RemoveMsg(MsgPort_t *mp, Msg_t *msg) {
+  DequeueMsg(mp, msg, false);
+}
+
+void ReplyMsg(MsgPort_t *mp) {
+  ReplyToMsg(mp, NextMsg(mp, NULL));
 }
@@ -0,0 +1,18 @@
+#include <FreeRTOS/FreeRTOS.h>
+#include <FreeRTOS/task.h>
+
+#include <mutex.h>
+#include <sleepq.h>
+
+/* The owner clears the lock before it looks at `waiters`, while we bump it
+ * before trying the lock again. Either we get the lock, or the owner sees us
+ * and wakes us up. Interrupts are masked, so the owner cannot release the lock
+ * between our attempt and going to sleep. */
+void MutexWait(Mutex_t *m) {
+  taskENTER_CRITICAL();
+  m->waiters++;
+  while (!AtomicTestAndSet(&m->locked))
+    (void)Sleep(m, portMAX_DELAY);
+  m->waiters--;
+  taskEXIT_CRITICAL();
+}
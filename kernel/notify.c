@@ -1,29 +1,22 @@
 #include <notify.h>
 
 NotifyBits_t NotifyWait(NotifyBits_t bitsToWaitFor, TickType_t ticksToWait) {
+  TimeOut_t timeOut;
   uint32_t value;
 
-  taskENTER_CRITICAL();
-  TaskHandle_t self = xTaskGetCurrentTaskHandle();
-  /* HACK: If notification has not been sent to `self` then xTaskNotifyWait
-   * will not clear bits in ulNotifiedValue. */
-  (void)xTaskGenericNotify(self, 0, eNoAction, NULL);
-  (void)xTaskNotifyWait(0, bitsToWaitFor, &value, 0);
-  if (!(value & bitsToWaitFor) && ticksToWait) {
-    TickType_t end = xTaskGetTickCount() + ticksToWait;
+  vTaskSetTimeOutState(&timeOut);
 
-    for (;;) {
-      if (xTaskNotifyWait(0, bitsToWaitFor, &value, ticksToWait))
-        if (value & bitsToWaitFor)
-          break;
-
-      TickType_t now = xTaskGetTickCount();
-      if (end <= now)
-        break;
-      ticksToWait = end - now;
-    }
+  for (;;) {
+    /* Bits may have been set by a notification that has been consumed by an
+     * earlier wait for other bits, so take them directly. */
+    value = ulTaskNotifyValueClear(NULL, bitsToWaitFor);
+    if (value & bitsToWaitFor)
+      break;
+    if (xTaskCheckForTimeOut(&timeOut, &ticksToWait))
+      break;
+    /* Any notification received in the meantime makes it return at once. */
+    (void)xTaskNotifyWait(0, 0, NULL, ticksToWait);
   }
-  taskEXIT_CRITICAL();
 
   return value & bitsToWaitFor;
 }
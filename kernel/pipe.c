@@ -1,7 +1,298 @@
+#include <FreeRTOS/FreeRTOS.h>
+#include <FreeRTOS/semphr.h>
+#include <FreeRTOS/task.h>
+
+#include <event.h>
+#include <file.h>
+#include <ioreq.h>
+#include <memory.h>
+#include <notify.h>
 #include <pipe.h>
+#include <ring.h>
+#include <string.h>
 #include <sys/errno.h>
 
+#define DEBUG 0
+#include <debug.h>
+
+#define PIPE_SIZE 4096
+
+/* Both ends of the pipe share this object. Data written to the pipe is stored
+ * in the ring buffer, unless a reader is already waiting. In such case the
+ * writer copies data straight into reader's request buffer.
+ *
+ * Readers and writers are serialized by `rdLock` and `wrLock` respectively,
+ * so at most one task of each kind can be waiting for the other side. */
+struct Pipe {
+  Ring_t *buf;
+  SemaphoreHandle_t rdLock; /* held by the reader for the whole request */
+  SemaphoreHandle_t wrLock; /* held by the writer for the whole request */
+  SemaphoreHandle_t lock;   /* protects fields below */
+  TaskHandle_t reader;      /* reader waiting for data */
+  TaskHandle_t writer;      /* writer waiting for free space */
+  IoReq_t *rdreq;           /* request of waiting reader */
+  EventWaitList_t readEvent;
+  EventWaitList_t writeEvent;
+  bool rclosed;
+  bool wclosed;
+};
+
+static int PipeRead(File_t *f, IoReq_t *req);
+static int PipeWrite(File_t *f, IoReq_t *req);
+static int PipeIoctl(File_t *f, u_long cmd, void *data);
+static int PipeSeek(File_t *f, long offset, int whence);
+static int PipeClose(File_t *f);
+static int PipeEvent(File_t *f, EvAction_t act, EvFilter_t filt);
+static bool PipeReady(File_t *f, EvFilter_t filt);
+
+static FileOps_t PipeOps = {
+  .read = PipeRead,
+  .write = PipeWrite,
+  .ioctl = PipeIoctl,
+  .seek = PipeSeek,
+  .close = PipeClose,
+  .event = PipeEvent,
+  .ready = PipeReady,
+};
+
+static void PipeFree(Pipe_t *p) {
+  DASSERT(TAILQ_EMPTY(&p->readEvent));
+  DASSERT(TAILQ_EMPTY(&p->writeEvent));
+
+  if (p->buf)
+    RingFree(p->buf);
+  if (p->rdLock)
+    vSemaphoreDelete(p->rdLock);
+  if (p->wrLock)
+    vSemaphoreDelete(p->wrLock);
+  if (p->lock)
+    vSemaphoreDelete(p->lock);
+  MemFree(p);
+}
+
+static File_t *PipeFile(Pipe_t *p, FileFlags_t flags) {
+  File_t *f = FileAlloc();
+  if (f) {
+    f->ops = &PipeOps;
+    f->type = FT_PIPE;
+    f->pipe = p;
+    f->flags = flags;
+  }
+  return f;
+}
+
 int PipeAlloc(File_t **rfilep, File_t **wfilep) {
-  (void)rfilep, (void)wfilep;
-  return ENOSYS;
+  Pipe_t *p = MemAlloc(sizeof(Pipe_t), MF_ZERO | MF_TRY | MF_TAG(MT_KERNEL));
+  if (p == NULL)
+    return ENOMEM;
+
+  TAILQ_INIT(&p->readEvent);
+  TAILQ_INIT(&p->writeEvent);
+
+  p->buf = RingAlloc(PIPE_SIZE, MF_TRY | MF_TAG(MT_KERNEL));
+  p->rdLock = xSemaphoreCreateMutex();
+  p->wrLock = xSemaphoreCreateMutex();
+  p->lock = xSemaphoreCreateMutex();
+
+  if (!p->buf || !p->rdLock || !p->wrLock || !p->lock)
+    goto nomem;
+
+  if (!(*rfilep = PipeFile(p, F_READ)))
+    goto nomem;
+
+  if (!(*wfilep = PipeFile(p, F_WRITE))) {
+    FileFree(*rfilep);
+    goto nomem;
+  }
+
+  return 0;
+
+nomem:
+  PipeFree(p);
+  return ENOMEM;
+}
+
+/* Wake up the writer waiting for free space and tasks monitoring
+ * can-write event. Must be called with `lock` held. */
+static void PipeWakeWriter(Pipe_t *p) {
+  if (p->writer)
+    NotifySend(p->writer, NB_EVENT);
+  EventNotify(&p->writeEvent);
+}
+
+/* Wake up the reader waiting for data and tasks monitoring can-read event.
+ * Must be called with `lock` held. */
+static void PipeWakeReader(Pipe_t *p) {
+  if (p->reader)
+    NotifySend(p->reader, NB_EVENT);
+  EventNotify(&p->readEvent);
+}
+
+/* Release `lock` and sleep until the other side of the pipe wakes us up. */
+static void PipeSleep(Pipe_t *p) {
+  xSemaphoreGive(p->lock);
+  (void)NotifyWait(NB_EVENT, portMAX_DELAY);
+  xSemaphoreTake(p->lock, portMAX_DELAY);
+}
+
+static int PipeRead(File_t *f, IoReq_t *req) {
+  Pipe_t *p = f->pipe;
+  size_t n = req->left;
+  int error = 0;
+
+  if (n == 0)
+    return 0;
+
+  xSemaphoreTake(p->rdLock, portMAX_DELAY);
+  xSemaphoreTake(p->lock, portMAX_DELAY);
+
+  /* Wait until either the writer puts data into the ring buffer or copies it
+   * directly into our request. */
+  while (RingEmpty(p->buf) && req->left == n) {
+    /* All writers are gone, so report end of file. */
+    if (p->wclosed)
+      break;
+    /* Nonblocking mode: signify that we would have blocked and leave. */
+    if (req->flags & F_NONBLOCK) {
+      error = EAGAIN;
+      break;
+    }
+    p->reader = xTaskGetCurrentTaskHandle();
+    p->rdreq = req;
+    PipeSleep(p);
+    p->reader = NULL;
+    p->rdreq = NULL;
+  }
+
+  if (!RingEmpty(p->buf)) {
+    RingRead(p->buf, req);
+    PipeWakeWriter(p);
+  }
+
+  DLOG("pipe: read %d bytes\n", n - req->left);
+
+  xSemaphoreGive(p->lock);
+  xSemaphoreGive(p->rdLock);
+
+  return error;
+}
+
+/* Transfer data from writer's request into reader's request buffer. */
+static void PipeHandOff(IoReq_t *rd, IoReq_t *wr) {
+  while (rd->left > 0 && wr->left > 0) {
+    size_t len = min(IoReqSegLen(rd), IoReqSegLen(wr));
+    memcpy(rd->rbuf, wr->wbuf, len);
+    IoReqAdvance(rd, len);
+    IoReqAdvance(wr, len);
+  }
+}
+
+static int PipeWrite(File_t *f, IoReq_t *req) {
+  Pipe_t *p = f->pipe;
+  size_t n = req->left;
+  int error = 0;
+
+  xSemaphoreTake(p->wrLock, portMAX_DELAY);
+  xSemaphoreTake(p->lock, portMAX_DELAY);
+
+  for (;;) {
+    /* Nobody is going to read the data. Report a short write if some data
+     * went through already. */
+    if (p->rclosed) {
+      if (req->left == n)
+        error = EPIPE;
+      break;
+    }
+
+    /* The reader waits only if the ring buffer is empty, so data will not
+     * get reordered if we skip the buffer. */
+    if (p->rdreq) {
+      PipeHandOff(p->rdreq, req);
+      p->rdreq = NULL;
+      NotifySend(p->reader, NB_EVENT);
+    }
+
+    if (req->left > 0) {
+      size_t left = req->left;
+      RingWrite(p->buf, req);
+      if (req->left < left)
+        PipeWakeReader(p);
+    }
+
+    if (req->left == 0)
+      break;
+
+    /* Nonblocking mode: if the request was partially filled then return with
+     * short count, otherwise signify that we would have blocked and leave. */
+    if (req->flags & F_NONBLOCK) {
+      if (req->left == n)
+        error = EAGAIN;
+      break;
+    }
+
+    p->writer = xTaskGetCurrentTaskHandle();
+    PipeSleep(p);
+    p->writer = NULL;
+  }
+
+  DLOG("pipe: wrote %d bytes\n", n - req->left);
+
+  xSemaphoreGive(p->lock);
+  xSemaphoreGive(p->wrLock);
+
+  return error;
+}
+
+static int PipeIoctl(File_t *f __unused, u_long cmd __unused,
+                     void *data __unused) {
+  return EINVAL;
+}
+
+static int PipeSeek(File_t *f __unused, long offset __unused,
+                    int whence __unused) {
+  return ESPIPE;
+}
+
+static int PipeClose(File_t *f) {
+  Pipe_t *p = f->pipe;
+
+  xSemaphoreTake(p->lock, portMAX_DELAY);
+
+  /* Let the other side know it will not get any more data or free space. */
+  if (f->flags & F_READ) {
+    p->rclosed = true;
+    PipeWakeWriter(p);
+  } else {
+    p->wclosed = true;
+    PipeWakeReader(p);
+  }
+
+  bool last = p->rclosed && p->wclosed;
+
+  xSemaphoreGive(p->lock);
+
+  FileFree(f);
+  if (last)
+    PipeFree(p);
+  return 0;
+}
+
+static int PipeEvent(File_t *f, EvAction_t act, EvFilter_t filt) {
+  Pipe_t *p = f->pipe;
+  if (filt == EVFILT_READ && (f->flags & F_READ))
+    return EventMonitor(&p->readEvent, act);
+  if (filt == EVFILT_WRITE && (f->flags & F_WRITE))
+    return EventMonitor(&p->writeEvent, act);
+  return EINVAL;
+}
+
+/* Reading at end of file and writing to a pipe without readers do not block
+ * either. */
+static bool PipeReady(File_t *f, EvFilter_t filt) {
+  Pipe_t *p = f->pipe;
+  if (filt == EVFILT_READ && (f->flags & F_READ))
+    return !RingEmpty(p->buf) || p->wclosed;
+  if (filt == EVFILT_WRITE && (f->flags & F_WRITE))
+    return !RingFull(p->buf) || p->rclosed;
+  return false;
 }
@@ -12,13 +12,12 @@ typedef struct FileBuf {
 } FileBuf_t;
 
 static void FBPutChar(FileBuf_t *fb, char c) {
-  if (fb->cur < BUFSIZ) {
-    fb->buf[fb->cur++] = c;
-  } else {
+  if (fb->cur == BUFSIZ) {
     long r;
     FileWrite(fb->file, fb->buf, BUFSIZ, &r);
     fb->cur = 0;
   }
+  fb->buf[fb->cur++] = c;
 }
 
 static void FBFlush(FileBuf_t *fb) {
@@ -8,6 +8,8 @@
 #include <strings.h>
 #include <proc.h>
 
+#include <sys/errno.h>
+
 Proc_t *TaskGetProc(void) {
   return pvTaskGetThreadLocalStoragePointer(NULL, TLS_PROC);
 }
@@ -44,6 +46,48 @@ void ProcFreeImage(Proc_t *proc) {
   }
 }
 
+/* Process heap is made of chunks allocated with MemAlloc. Each chunk begins
+ * with a pointer to previously allocated one, so ProcFini can release them.
+ * Header size keeps program break aligned to 8 bytes. The header comes on top
+ * of HEAP_CHUNKSZ usable bytes, so that user-space malloc, which grows heap in
+ * steps that divide HEAP_CHUNKSZ, fills chunks without leaving gaps. */
+#define HEAP_CHUNKSZ 16384
+#define HEAP_HDRSZ 8
+
+int ProcSbrk(Proc_t *proc, intptr_t incr, void **ptrp) {
+  intptr_t brk = proc->brk;
+
+  incr = (incr < 0) ? -roundup(-incr, 8) : roundup(incr, 8);
+
+  if (incr < 0) {
+    /* Only the last chunk can shrink, earlier ones are never freed. */
+    if (proc->heap == NULL || brk + incr < (intptr_t)proc->heap + HEAP_HDRSZ)
+      return EINVAL;
+  } else if (incr > 0 && (proc->heap == NULL || brk + incr > proc->brkend)) {
+    size_t size = max((size_t)incr, (size_t)HEAP_CHUNKSZ) + HEAP_HDRSZ;
+    void **chunk = MemAlloc(size, MF_TRY | MF_TAG(MT_PROC));
+    if (chunk == NULL)
+      return ENOMEM;
+    *chunk = proc->heap;
+    proc->heap = chunk;
+    proc->brkend = (intptr_t)chunk + size;
+    brk = (intptr_t)chunk + HEAP_HDRSZ;
+  }
+
+  proc->brk = brk + incr;
+  *ptrp = (void *)brk;
+  return 0;
+}
+
+static void ProcFreeHeap(Proc_t *proc) {
+  void **next;
+  for (void **chunk = proc->heap; chunk != NULL; chunk = next) {
+    next = *chunk;
+    MemFree(chunk);
+  }
+  proc->heap = NULL;
+}
+
 void ProcInit(Proc_t *proc, size_t ustksz) {
   static int pid = 1; /* let's assume it will never overflow */
 
@@ -52,14 +96,14 @@ void ProcInit(Proc_t *proc, size_t ustksz) {
   /* Align to long word size. */
   ustksz = (ustksz + 3) & -4;
   proc->ustksz = ustksz;
-  proc->ustk = MemAlloc(ustksz, 0);
-  bzero(proc->ustk, ustksz);
+  proc->ustk = MemAlloc(ustksz, MF_ZERO | MF_TAG(MT_PROC));
 
   proc->pid = pid++;
 }
 
 void ProcFini(Proc_t *proc) {
   ProcFreeImage(proc);
+  ProcFreeHeap(proc);
 
   for (int i = 0; i < MAXFILES; i++) {
     File_t *f = proc->fdtab[i];
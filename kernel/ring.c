@@ -2,67 +2,99 @@
 #include <ring.h>
 #include <string.h>
 #include <memory.h>
+#include <debug.h>
 
-static inline void RingProduce(Ring_t *buf, size_t len) {
-  buf->count += len;
-  buf->head += len;
-  if (buf->head == buf->size)
-    buf->head = 0;
+void RingPutByte(Ring_t *buf, uint8_t byte) {
+  size_t head = buf->head;
+  buf->data[head & (buf->size - 1)] = byte;
+  __compiler_membar();
+  buf->head = head + 1;
 }
 
-static inline void RingConsume(Ring_t *buf, size_t len) {
-  buf->count -= len;
-  buf->tail += len;
-  if (buf->tail == buf->size)
-    buf->tail = 0;
+uint8_t RingGetByte(Ring_t *buf) {
+  size_t tail = buf->tail;
+  uint8_t byte = buf->data[tail & (buf->size - 1)];
+  __compiler_membar();
+  buf->tail = tail + 1;
+  return byte;
 }
 
-void RingPutByte(Ring_t *buf, uint8_t byte) {
-  buf->data[buf->head] = byte;
-  RingProduce(buf, 1);
+void RingReserveWrite(Ring_t *buf, uint8_t **ptrp, size_t *lenp) {
+  size_t head = buf->head;
+  size_t off = head & (buf->size - 1);
+  size_t avail = buf->size - (head - buf->tail);
+  /* free space is either [head, tail) or [head, size) */
+  *ptrp = buf->data + off;
+  *lenp = min(avail, buf->size - off);
+  __compiler_membar();
 }
 
-uint8_t RingGetByte(Ring_t *buf) {
-  uint8_t byte = buf->data[buf->tail];
-  RingConsume(buf, 1);
-  return byte;
+void RingCommitWrite(Ring_t *buf, size_t len) {
+  __compiler_membar();
+  buf->head += len;
+}
+
+void RingPeekRead(Ring_t *buf, uint8_t **ptrp, size_t *lenp) {
+  size_t tail = buf->tail;
+  size_t off = tail & (buf->size - 1);
+  size_t used = buf->head - tail;
+  /* used space is either [tail, head) or [tail, size) */
+  *ptrp = buf->data + off;
+  *lenp = min(used, buf->size - off);
+  __compiler_membar();
+}
+
+void RingConsumeRead(Ring_t *buf, size_t len) {
+  __compiler_membar();
+  buf->tail += len;
 }
 
 void RingRead(Ring_t *buf, IoReq_t *req) {
-  /* repeat when used space is split into two parts */
-  while (req->left && !RingEmpty(buf)) {
-    /* used space is either [tail, head) or [tail, size) */
-    size_t size =
-      (buf->tail < buf->head) ? buf->head - buf->tail : buf->size - buf->tail;
-    if (size > req->left)
-      size = req->left;
-    memcpy(req->rbuf, buf->data + buf->tail, size);
-    req->rbuf += size;
-    req->left -= size;
-    RingConsume(buf, size);
+  /* repeat when used space wraps around the end of buffer or when request
+   * buffer is made of many segments */
+  while (req->left) {
+    uint8_t *ptr;
+    size_t len;
+
+    RingPeekRead(buf, &ptr, &len);
+    if (len == 0)
+      break;
+    len = min(len, IoReqSegLen(req));
+    memcpy(req->rbuf, ptr, len);
+    IoReqAdvance(req, len);
+    RingConsumeRead(buf, len);
   }
 }
 
 void RingWrite(Ring_t *buf, IoReq_t *req) {
-  /* repeat when free space is split into two parts */
-  while (req->left && !RingFull(buf)) {
-    /* free space is either [head, tail) or [head, size) */
-    size_t size =
-      (buf->head < buf->tail) ? buf->tail - buf->head : buf->size - buf->head;
-    if (size > req->left)
-      size = req->left;
-    memcpy(buf->data + buf->head, req->wbuf, size);
-    req->wbuf += size;
-    req->left -= size;
-    RingProduce(buf, size);
+  /* repeat when free space wraps around the end of buffer or when request
+   * buffer is made of many segments */
+  while (req->left) {
+    uint8_t *ptr;
+    size_t len;
+
+    RingReserveWrite(buf, &ptr, &len);
+    if (len == 0)
+      break;
+    len = min(len, IoReqSegLen(req));
+    memcpy(ptr, req->wbuf, len);
+    IoReqAdvance(req, len);
+    RingCommitWrite(buf, len);
   }
 }
 
-Ring_t *RingAlloc(size_t size) {
-  Ring_t *buf = MemAlloc(sizeof(Ring_t) + size, 0);
+Ring_t *RingAlloc(size_t size, MemFlags_t flags) {
+  Assert(size > 0 && (size & (size - 1)) == 0);
+
+  Ring_t *buf = MemAlloc(sizeof(Ring_t) + size, flags);
+  if (buf == NULL)
+    return NULL;
   buf->head = 0;
   buf->tail = 0;
-  buf->count = 0;
   buf->size = size;
   return buf;
 }
+
+void RingFree(Ring_t *buf) {
+  MemFree(buf);
+}
@@ -0,0 +1,109 @@
+#include <FreeRTOS/FreeRTOS.h>
+#include <FreeRTOS/task.h>
+
+#include <notify.h>
+#include <sleepq.h>
+#include <sys/errno.h>
+#include <sys/queue.h>
+
+#define SLEEPQ_SIZE 32 /* must be a power of two */
+
+/* Lives on the stack of a sleeping task. */
+typedef struct Sleeper {
+  TAILQ_ENTRY(Sleeper) link;
+  const void *chan; /* cleared by the waker */
+  TaskHandle_t task;
+} Sleeper_t;
+
+typedef TAILQ_HEAD(, Sleeper) SleepQueue_t;
+
+/* Tasks sleeping on channels that hash to the same queue are kept on it in
+ * the order they went to sleep. Queues are initialized on first use. */
+static SleepQueue_t SleepQueue[SLEEPQ_SIZE];
+
+static SleepQueue_t *SleepQueueOf(const void *chan) {
+  uintptr_t h = (uintptr_t)chan;
+  SleepQueue_t *sq = &SleepQueue[((h >> 2) ^ (h >> 9)) & (SLEEPQ_SIZE - 1)];
+  if (sq->tqh_last == NULL)
+    TAILQ_INIT(sq);
+  return sq;
+}
+
+int Sleep(const void *chan, TickType_t timeout) {
+  Sleeper_t s = {.chan = chan, .task = xTaskGetCurrentTaskHandle()};
+  TimeOut_t timeOut;
+  int error = 0;
+
+  vTaskSetTimeOutState(&timeOut);
+
+  taskENTER_CRITICAL();
+  {
+    SleepQueue_t *sq = SleepQueueOf(chan);
+    TAILQ_INSERT_TAIL(sq, &s, link);
+
+    /* Other notifications may interrupt the wait as well. */
+    while (s.chan != NULL) {
+      if (xTaskCheckForTimeOut(&timeOut, &timeout)) {
+        TAILQ_REMOVE(sq, &s, link);
+        error = ETIMEDOUT;
+        break;
+      }
+      (void)xTaskNotifyWait(0, NB_SLEEP, NULL, timeout);
+    }
+  }
+  taskEXIT_CRITICAL();
+
+  return error;
+}
+
+/* Must be called with interrupts masked. */
+static int WakeupSleepers(const void *chan, bool one, bool isr) {
+  SleepQueue_t *sq = SleepQueueOf(chan);
+  Sleeper_t *s, *next;
+  int n = 0;
+
+  for (s = TAILQ_FIRST(sq); s != NULL; s = next) {
+    next = TAILQ_NEXT(s, link);
+    if (s->chan != chan)
+      continue;
+
+    TAILQ_REMOVE(sq, s, link);
+    s->chan = NULL;
+    if (isr)
+      NotifySendFromISR(s->task, NB_SLEEP);
+    else
+      NotifySend(s->task, NB_SLEEP);
+    n++;
+
+    if (one)
+      break;
+  }
+
+  return n;
+}
+
+void Wakeup(const void *chan) {
+  taskENTER_CRITICAL();
+  (void)WakeupSleepers(chan, false, false);
+  taskEXIT_CRITICAL();
+}
+
+bool WakeupOne(const void *chan) {
+  taskENTER_CRITICAL();
+  int n = WakeupSleepers(chan, true, false);
+  taskEXIT_CRITICAL();
+  return n > 0;
+}
+
+void WakeupFromISR(const void *chan) {
+  uint32_t ulSavedInterruptMask = portSET_INTERRUPT_MASK_FROM_ISR();
+  (void)WakeupSleepers(chan, false, true);
+  portCLEAR_INTERRUPT_MASK_FROM_ISR(ulSavedInterruptMask);
+}
+
+bool WakeupOneFromISR(const void *chan) {
+  uint32_t ulSavedInterruptMask = portSET_INTERRUPT_MASK_FROM_ISR();
+  int n = WakeupSleepers(chan, true, true);
+  portCLEAR_INTERRUPT_MASK_FROM_ISR(ulSavedInterruptMask);
+  return n > 0;
+}
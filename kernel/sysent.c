@@ -5,6 +5,7 @@
 #include <pipe.h>
 #include <file.h>
 #include <filedesc.h>
+#include <waitset.h>
 
 #include <sys/errno.h>
 #include <sys/syscall.h>
@@ -43,6 +44,75 @@ static int SysWrite(Proc_t *p, long *arg, long *res) {
   return FileWrite(f, (const void *)arg[1], (size_t)arg[2], res);
 }
 
+static int SysReadv(Proc_t *p, long *arg, long *res) {
+  File_t *f;
+  int error;
+
+  if ((error = FdGet(p, arg[0], &f)))
+    return error;
+
+  return FileReadv(f, (const struct iovec *)arg[1], (int)arg[2], res);
+}
+
+static int SysWritev(Proc_t *p, long *arg, long *res) {
+  File_t *f;
+  int error;
+
+  if ((error = FdGet(p, arg[0], &f)))
+    return error;
+
+  return FileWritev(f, (const struct iovec *)arg[1], (int)arg[2], res);
+}
+
+static int SysPoll(Proc_t *p, long *arg, long *res) {
+  struct pollfd *fds = (struct pollfd *)arg[0];
+  nfds_t nfds = arg[1];
+  long timeout = arg[2];
+  WaitItem_t ready[MAXFILES];
+  int error = 0, count = 0;
+
+  if (nfds > MAXFILES)
+    return EINVAL;
+
+  WaitSet_t *ws = WaitSetAlloc(nfds);
+  if (ws == NULL)
+    return ENOMEM;
+
+  for (nfds_t i = 0; i < nfds; i++) {
+    File_t *f;
+
+    fds[i].revents = 0;
+    if (fds[i].fd < 0)
+      continue;
+    if (FdGet(p, fds[i].fd, &f)) {
+      fds[i].revents = POLLNVAL;
+      count++;
+      continue;
+    }
+    if ((error = WaitSetAdd(ws, f, fds[i].events & (POLLIN | POLLOUT), i)))
+      goto leave;
+  }
+
+  /* Do not wait if there's an invalid descriptor to report. */
+  TickType_t ticks = portMAX_DELAY;
+  if (count > 0)
+    ticks = 0;
+  else if (timeout >= 0)
+    ticks = (timeout + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS;
+
+  int nready;
+  if ((error = WaitSetWait(ws, ready, MAXFILES, ticks, &nready)))
+    goto leave;
+
+  for (int i = 0; i < nready; i++)
+    fds[ready[i].udata].revents = ready[i].revents;
+  *res = count + nready;
+
+leave:
+  WaitSetFree(ws);
+  return error;
+}
+
 static int SysIoctl(Proc_t *p, long *arg, long *res __unused) {
   File_t *f;
   int error;
@@ -148,6 +218,19 @@ static int SysWait(Proc_t *p, long *arg, long *res) {
   return ENOSYS;
 }
 
+static int SysSbrk(Proc_t *p, long *arg, long *res) {
+  void *ptr;
+  int error;
+
+  if ((error = ProcSbrk(p, arg[0], &ptr))) {
+    *res = -1;
+    return error;
+  }
+
+  *res = (long)ptr;
+  return 0;
+}
+
 typedef int (*SysCall_t)(Proc_t *, long *, long *);
 
 static SysCall_t SysEnt[] = {
@@ -169,6 +252,10 @@ static SysCall_t SysEnt[] = {
   [SYS_unlink] = SysUnlink,
   [SYS_wait] = SysWait,
   [SYS_ioctl] = SysIoctl,
+  [SYS_sbrk] = SysSbrk,
+  [SYS_readv] = SysReadv,
+  [SYS_writev] = SysWritev,
+  [SYS_poll] = SysPoll,
   /* clang-format on */
 };
 
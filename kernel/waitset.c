@@ -0,0 +1,163 @@
+#include <FreeRTOS/FreeRTOS.h>
+#include <FreeRTOS/task.h>
+
+#include <event.h>
+#include <file.h>
+#include <memory.h>
+#include <notify.h>
+#include <waitset.h>
+#include <sys/errno.h>
+
+#define DEBUG 0
+#include <debug.h>
+
+typedef struct WaitEntry {
+  WaitItem_t item;
+  short monitored; /* conditions this entry registered the owner for */
+} WaitEntry_t;
+
+struct WaitSet {
+  TaskHandle_t owner;
+  short size;  /* capacity of `entry` array */
+  short count; /* number of files in the set */
+  short first; /* entry to check first, so that no file gets starved */
+  WaitEntry_t entry[];
+};
+
+WaitSet_t *WaitSetAlloc(int size) {
+  WaitSet_t *ws = MemAlloc(sizeof(WaitSet_t) + size * sizeof(WaitEntry_t),
+                           MF_ZERO | MF_TRY | MF_TAG(MT_KERNEL));
+  if (ws) {
+    ws->owner = xTaskGetCurrentTaskHandle();
+    ws->size = size;
+  }
+  return ws;
+}
+
+/* Register the owner for event `filt` if the entry waits for `cond`. Files
+ * that do not report the event are handled by FileReady, and the owner could
+ * have been registered already for a file that shares the event source. */
+static int WaitEntryMonitor(WaitEntry_t *we, short cond, EvFilter_t filt) {
+  if (!(we->item.events & cond) || (we->monitored & cond))
+    return 0;
+
+  int error = FileEvent(we->item.file, EV_ADD, filt);
+  if (error == 0)
+    we->monitored |= cond;
+  else if (error == ENOSYS || error == EINVAL || error == EEXIST)
+    error = 0;
+  return error;
+}
+
+static void WaitEntryForget(WaitEntry_t *we) {
+  if (we->monitored & POLLIN)
+    (void)FileEvent(we->item.file, EV_DELETE, EVFILT_READ);
+  if (we->monitored & POLLOUT)
+    (void)FileEvent(we->item.file, EV_DELETE, EVFILT_WRITE);
+  we->monitored = 0;
+}
+
+void WaitSetFree(WaitSet_t *ws) {
+  DASSERT(ws->owner == xTaskGetCurrentTaskHandle());
+
+  for (int i = 0; i < ws->count; i++)
+    WaitEntryForget(&ws->entry[i]);
+  MemFree(ws);
+}
+
+int WaitSetAdd(WaitSet_t *ws, File_t *f, short events, intptr_t udata) {
+  DASSERT(ws->owner == xTaskGetCurrentTaskHandle());
+
+  if (ws->count == ws->size)
+    return ENOSPC;
+
+  WaitEntry_t *we = &ws->entry[ws->count];
+  we->item = (WaitItem_t){.file = f, .udata = udata, .events = events};
+  we->monitored = 0;
+
+  int error;
+  if ((error = WaitEntryMonitor(we, POLLIN, EVFILT_READ)) ||
+      (error = WaitEntryMonitor(we, POLLOUT, EVFILT_WRITE))) {
+    WaitEntryForget(we);
+    return error;
+  }
+
+  ws->count++;
+  return 0;
+}
+
+int WaitSetDel(WaitSet_t *ws, File_t *f) {
+  DASSERT(ws->owner == xTaskGetCurrentTaskHandle());
+
+  for (int i = 0; i < ws->count; i++) {
+    WaitEntry_t *we = &ws->entry[i];
+    if (we->item.file == f) {
+      short monitored = we->monitored;
+      WaitEntryForget(we);
+      *we = ws->entry[--ws->count];
+      /* Registration could have been shared with files that remain in the set,
+       * so they have to take it over. */
+      if (monitored) {
+        for (int j = 0; j < ws->count; j++) {
+          (void)WaitEntryMonitor(&ws->entry[j], POLLIN, EVFILT_READ);
+          (void)WaitEntryMonitor(&ws->entry[j], POLLOUT, EVFILT_WRITE);
+        }
+      }
+      return 0;
+    }
+  }
+
+  return ENOENT;
+}
+
+/* Copies items of ready files into `ready` array and returns their number. */
+static int WaitSetScan(WaitSet_t *ws, WaitItem_t *ready, int nready) {
+  int start = ws->first;
+  int next = start;
+  int count = 0;
+
+  for (int n = 0; n < ws->count && count < nready; n++) {
+    int i = (start + n) % ws->count;
+    WaitItem_t *item = &ws->entry[i].item;
+
+    item->revents = 0;
+    if ((item->events & POLLIN) && FileReady(item->file, EVFILT_READ))
+      item->revents |= POLLIN;
+    if ((item->events & POLLOUT) && FileReady(item->file, EVFILT_WRITE))
+      item->revents |= POLLOUT;
+
+    if (item->revents) {
+      ready[count++] = *item;
+      next = (i + 1) % ws->count;
+    }
+  }
+
+  /* Next scan starts past the last reported file. */
+  ws->first = next;
+  return count;
+}
+
+int WaitSetWait(WaitSet_t *ws, WaitItem_t *ready, int nready,
+                TickType_t timeout, int *countp) {
+  TimeOut_t timeOut;
+  int count;
+
+  DASSERT(ws->owner == xTaskGetCurrentTaskHandle());
+
+  if (nready <= 0)
+    return EINVAL;
+
+  vTaskSetTimeOutState(&timeOut);
+
+  /* Files notify us when their state changes, so it is enough to check them
+   * again after wakeup. Events that happen in between set NB_EVENT, so that
+   * NotifyWait will not block. */
+  while (!(count = WaitSetScan(ws, ready, nready))) {
+    if (xTaskCheckForTimeOut(&timeOut, &timeout))
+      break;
+    (void)NotifyWait(NB_EVENT, timeout);
+  }
+
+  *countp = count;
+  return 0;
+}
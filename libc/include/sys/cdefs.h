@@ -63,6 +63,10 @@ static inline div16_t divs16(int32_t a, int16_t b) {
 #define BSET(x, b) ((x) |= BIT(b))
 #define BCLR(x, b) ((x) &= ~BIT(b))
 
+/* Prevents compiler from reordering memory accesses across this point.
+ * Sufficient to order accesses between tasks and interrupts on single CPU. */
+#define __compiler_membar() asm volatile("" ::: "memory")
+
 #define roundup(x, y) ((((x) + ((y) - 1)) / (y)) * (y))
 #define rounddown(x, y) (((x) / (y)) * (y))
 
@@ -1,18 +1,22 @@
 #pragma once
 
-#define ENOENT 2  /* No such file or directory */
-#define ESRCH 3   /* No such process */
-#define ENXIO 6   /* Device not configured */
-#define EBADF 9   /* Bad file descriptor */
-#define ENOMEM 12 /* Cannot allocate memory */
-#define EACCES 13 /* Permission denied */
-#define EFAULT 14 /* Bad address */
-#define EBUSY 16  /* Device or resource busy */
-#define EEXIST 17 /* File exists */
-#define EINVAL 22 /* Invalid argument */
-#define EMFILE 24 /* Too many open files */
-#define ENOSPC 28 /* No space left on device */
-#define ESPIPE 29 /* Illegal seek */
-#define EROFS 30  /* Read-only file system */
-#define EAGAIN 35 /* Resource temporarily unavailable */
-#define ENOSYS 78 /* Function not implemented */
+#define ENOENT 2     /* No such file or directory */
+#define ESRCH 3      /* No such process */
+#define EIO 5        /* Input/output error */
+#define ENXIO 6      /* Device not configured */
+#define EBADF 9      /* Bad file descriptor */
+#define ENOMEM 12    /* Cannot allocate memory */
+#define EACCES 13    /* Permission denied */
+#define EFAULT 14    /* Bad address */
+#define EBUSY 16     /* Device or resource busy */
+#define EEXIST 17    /* File exists */
+#define EINVAL 22    /* Invalid argument */
+#define EMFILE 24    /* Too many open files */
+#define ENOSPC 28    /* No space left on device */
+#define ESPIPE 29    /* Illegal seek */
+#define EROFS 30     /* Read-only file system */
+#define EPIPE 32     /* Broken pipe */
+#define EAGAIN 35    /* Resource temporarily unavailable */
+#define ETIMEDOUT 60 /* Operation timed out */
+#define ENOSYS 78    /* Function not implemented */
+#define ECANCELED 85 /* Operation canceled */
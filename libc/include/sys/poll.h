@@ -0,0 +1,24 @@
+#pragma once
+
+#include <sys/types.h>
+
+typedef unsigned int nfds_t;
+
+/* Describes a file descriptor and conditions to wait for with poll. */
+struct pollfd {
+  int fd;        /* file descriptor to be polled */
+  short events;  /* conditions the caller is interested in */
+  short revents; /* conditions that hold, filled in by poll */
+};
+
+#define POLLIN 0x0001   /* data can be read without blocking */
+#define POLLOUT 0x0004  /* data can be written without blocking */
+#define POLLNVAL 0x0020 /* invalid file descriptor (only in revents) */
+
+#define INFTIM (-1) /* wait indefinitely */
+
+#ifdef _USERSPACE
+
+int poll(struct pollfd *, nfds_t, int);
+
+#endif
@@ -17,7 +17,11 @@
 #define SYS_unlink 15
 #define SYS_wait 16
 #define SYS_ioctl 17
-#define SYS_MAXSYSCALL 18
+#define SYS_sbrk 18
+#define SYS_readv 19
+#define SYS_writev 20
+#define SYS_poll 21
+#define SYS_MAXSYSCALL 22
 
 /* Operand classes are described in gcc/config/m68k/m68k.md */
 #define SYSCALL0(res, nr)                                                      \
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <sys/types.h>
+
+/* Describes one segment of a buffer for scatter/gather I/O. */
+struct iovec {
+  void *iov_base; /* base address of the segment */
+  size_t iov_len; /* length of the segment */
+};
+
+#define IOV_MAX 16 /* maximum number of segments in a single request */
+
+#ifdef _USERSPACE
+
+ssize_t readv(int, const struct iovec *, int);
+ssize_t writev(int, const struct iovec *, int);
+
+#endif
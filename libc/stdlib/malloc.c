@@ -1,81 +1,203 @@
+#include <sys/cdefs.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <strings.h>
 #include <unistd.h>
 
-// Memory allocator by Kernighan and Ritchie,
-// The C programming Language, 2nd ed.  Section 8.7.
-
-typedef long Align;
-
-union header {
-  struct {
-    union header *ptr;
-    u_int size;
-  } s;
-  Align x;
-};
-
-typedef union header Header;
-
-static Header base;
-static Header *freep;
-
-void free(void *ap) {
-  Header *bp, *p;
-
-  bp = (Header *)ap - 1;
-  for (p = freep; !(bp > p && bp < p->s.ptr); p = p->s.ptr)
-    if (p >= p->s.ptr && (bp > p || bp < p->s.ptr))
-      break;
-  if (bp + bp->s.size == p->s.ptr) {
-    bp->s.size += p->s.ptr->s.size;
-    bp->s.ptr = p->s.ptr->s.ptr;
-  } else
-    bp->s.ptr = p->s.ptr;
-  if (p + p->s.size == bp) {
-    p->s.size += bp->s.size;
-    p->s.ptr = bp->s.ptr;
-  } else
-    p->s.ptr = bp;
-  freep = p;
+/*
+ * Binned memory allocator with boundary tags.
+ *
+ * Each chunk begins with a header that stores its size and two flags: whether
+ * the chunk is in use and whether its predecessor is in use. Free chunks also
+ * store their size at the end (i.e. in `prev_size` of the next chunk), so that
+ * free can merge a chunk with both of its neighbours in constant time.
+ *
+ * Free chunks are kept on doubly linked lists (bins). Chunks smaller than
+ * SMALLSZ have a bin per size, larger ones are binned by power of two. A bitmap
+ * of non-empty bins lets malloc find the next bin with a fitting chunk quickly.
+ *
+ * Memory is obtained with sbrk. Each region ends with a fencepost, i.e. a chunk
+ * header marked as used, so that free never merges chunks across regions. If
+ * new region directly follows the previous one the fencepost is reused.
+ */
+
+typedef struct chunk {
+  size_t prev_size;          /* size of previous chunk, valid if it is free */
+  size_t size;               /* size of this chunk with C_* flags */
+  struct chunk *next, *prev; /* links to neighbours in bin, if chunk is free */
+} chunk_t;
+
+#define C_INUSE 1
+#define C_PINUSE 2
+#define C_FLAGS (C_INUSE | C_PINUSE)
+
+#define ALIGN 8
+#define HDRSZ (2 * sizeof(size_t))
+#define MINCHUNK sizeof(chunk_t)
+#define MORECORE 8192
+
+#define NSMALL 64
+#define SMALLSZ (NSMALL * ALIGN)
+#define NBINS (NSMALL + 24)
+#define NWORDS ((NBINS + 31) / 32)
+
+static chunk_t *Bins[NBINS];
+static uint32_t BinMap[NWORDS];
+static chunk_t *Fence;
+
+#define chunk_size(c) ((c)->size & ~C_FLAGS)
+#define chunk_at(c, off) ((chunk_t *)((char *)(c) + (off)))
+#define chunk_next(c) chunk_at(c, chunk_size(c))
+#define chunk_prev(c) chunk_at(c, -(c)->prev_size)
+#define chunk_mem(c) ((void *)&(c)->next)
+#define mem_chunk(p) ((chunk_t *)((char *)(p) - HDRSZ))
+
+static inline int bin_index(size_t size) {
+  if (size < SMALLSZ)
+    return size / ALIGN;
+
+  int i = NSMALL;
+  for (size /= SMALLSZ * 2; size > 0 && i < NBINS - 1; size >>= 1)
+    i++;
+  return i;
+}
+
+static void bin_insert(chunk_t *c, size_t size) {
+  int i = bin_index(size);
+  chunk_t *head = Bins[i];
+  c->prev = NULL;
+  c->next = head;
+  if (head)
+    head->prev = c;
+  Bins[i] = c;
+  BinMap[i / 32] |= 1U << (i % 32);
 }
 
-static Header *morecore(u_int nu) {
-  char *p;
-  Header *hp;
+static void bin_remove(chunk_t *c) {
+  if (c->prev) {
+    c->prev->next = c->next;
+  } else {
+    int i = bin_index(chunk_size(c));
+    if (!(Bins[i] = c->next))
+      BinMap[i / 32] &= ~(1U << (i % 32));
+  }
+  if (c->next)
+    c->next->prev = c->prev;
+}
+
+/* Returns the first non-empty bin with index not less than `i`. */
+static int bin_find(int i) {
+  for (int w = i / 32; w < NWORDS; w++, i = w * 32) {
+    uint32_t map = BinMap[w] & (~0U << (i % 32));
+    if (map)
+      return w * 32 + ffs(map) - 1;
+  }
+  return -1;
+}
+
+/* Marks chunk `c` of given size as free and puts it into a bin. */
+static void chunk_release(chunk_t *c, size_t size) {
+  chunk_t *next = chunk_at(c, size);
+  c->size = size | (c->size & C_PINUSE);
+  next->prev_size = size;
+  next->size &= ~C_PINUSE;
+  bin_insert(c, size);
+}
+
+/* Takes `size` bytes of free chunk `c` that is not in a bin any longer. */
+static void *chunk_use(chunk_t *c, size_t size) {
+  size_t csize = chunk_size(c);
+
+  if (csize - size >= MINCHUNK) {
+    chunk_t *rest = chunk_at(c, size);
+    rest->size = C_PINUSE;
+    chunk_release(rest, csize - size);
+  } else {
+    size = csize;
+    chunk_next(c)->size |= C_PINUSE;
+  }
+
+  c->size = size | C_INUSE | (c->size & C_PINUSE);
+  return chunk_mem(c);
+}
 
-  if (nu < 4096)
-    nu = 4096;
-  p = sbrk(nu * sizeof(Header));
+static int morecore(size_t size) {
+  size_t incr = roundup(size + HDRSZ, MORECORE);
+  char *p = sbrk(incr);
   if (p == (char *)-1)
     return 0;
-  hp = (Header *)p;
-  hp->s.size = nu;
-  free((void *)(hp + 1));
-  return freep;
+
+  chunk_t *c;
+  if (Fence && (char *)Fence + HDRSZ == p) {
+    /* New region extends the last one, so fencepost becomes chunk header. */
+    c = Fence;
+  } else {
+    c = (chunk_t *)p;
+    c->size = C_PINUSE;
+    incr -= HDRSZ;
+  }
+
+  Fence = chunk_at(c, incr);
+  Fence->size = C_INUSE;
+
+  /* Let free merge new chunk with a free chunk preceding the fencepost. */
+  c->size = incr | C_INUSE | (c->size & C_PINUSE);
+  free(chunk_mem(c));
+  return 1;
 }
 
-void *malloc(u_int nbytes) {
-  Header *p, *prevp;
-  u_int nunits;
+void free(void *ptr) {
+  if (ptr == NULL)
+    return;
+
+  chunk_t *c = mem_chunk(ptr);
+  size_t size = chunk_size(c);
+  chunk_t *next = chunk_at(c, size);
+
+  if (!(next->size & C_INUSE)) {
+    bin_remove(next);
+    size += chunk_size(next);
+  }
 
-  nunits = (nbytes + sizeof(Header) - 1) / sizeof(Header) + 1;
-  if ((prevp = freep) == 0) {
-    base.s.ptr = freep = prevp = &base;
-    base.s.size = 0;
+  if (!(c->size & C_PINUSE)) {
+    chunk_t *prev = chunk_prev(c);
+    bin_remove(prev);
+    size += chunk_size(prev);
+    c = prev;
   }
-  for (p = prevp->s.ptr;; prevp = p, p = p->s.ptr) {
-    if (p->s.size >= nunits) {
-      if (p->s.size == nunits)
-        prevp->s.ptr = p->s.ptr;
-      else {
-        p->s.size -= nunits;
-        p += p->s.size;
-        p->s.size = nunits;
+
+  chunk_release(c, size);
+}
+
+void *malloc(size_t nbytes) {
+  if ((ssize_t)nbytes < 0)
+    return NULL;
+
+  size_t size = max(roundup(nbytes + sizeof(size_t), ALIGN), MINCHUNK);
+  int i = bin_index(size);
+
+  for (;;) {
+    chunk_t *c;
+
+    /* Chunks in a bin for large sizes differ in size, so look for a fit. */
+    if (size >= SMALLSZ) {
+      for (c = Bins[i]; c != NULL; c = c->next) {
+        if (chunk_size(c) >= size) {
+          bin_remove(c);
+          return chunk_use(c, size);
+        }
       }
-      freep = prevp;
-      return (void *)(p + 1);
     }
-    if (p == freep)
-      if ((p = morecore(nunits)) == 0)
-        return 0;
+
+    /* Any chunk from bins that follow is large enough. */
+    int j = bin_find(size >= SMALLSZ ? i + 1 : i);
+    if (j >= 0) {
+      c = Bins[j];
+      bin_remove(c);
+      return chunk_use(c, size);
+    }
+
+    if (!morecore(size))
+      return NULL;
   }
 }
@@ -0,0 +1,8 @@
+#include <sys/syscall.h>
+#include <sys/poll.h>
+
+int poll(struct pollfd *fds, nfds_t nfds, int timeout) {
+  int res;
+  SYSCALL3(res, SYS_poll, fds, nfds, timeout);
+  return res;
+}
@@ -0,0 +1,8 @@
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+ssize_t writev(int fd, const struct iovec *iov, int iovcnt) {
+  ssize_t res;
+  SYSCALL3(res, SYS_writev, fd, iov, iovcnt);
+  return res;
+}
@@ -0,0 +1,339 @@
+/*
+ * Replays allocator traces recorded by kernel built with MEMTRACE=1 option
+ * against host build of kernel/memory.c. Reports replay speed, the longest
+ * walk over a free block list and fragmentation of free memory over time.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <FreeRTOS/FreeRTOS.h>
+#include <FreeRTOS/task.h>
+#include <memory.h>
+#include <boot.h>
+
+void vPortDefineMemoryRegions(MemRegion_t *regions);
+void vPortCleanUpTCB(void *tcb);
+size_t xPortGetFreeHeapSize(void);
+
+extern TickType_t ReplayTick;
+
+#define TLS_MEMCACHE 1
+
+/* Chip memory is mapped at the lowest address Linux lets us use, so that
+ * the allocator classifies it as chip memory (below 2MiB). */
+#define CHIP_BASE 0x10000
+#define CHIP_MAXSZ (0x200000 - CHIP_BASE)
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
+/* --=[ trace ]=------------------------------------------------------------ */
+
+static MemTraceRec_t *Trace;
+static size_t TraceLen, TraceDropped;
+
+static void swap_rec(MemTraceRec_t *r) {
+  r->tick = __builtin_bswap32(r->tick);
+  r->op = __builtin_bswap16(r->op);
+  r->flags = __builtin_bswap16(r->flags);
+  r->size = __builtin_bswap32(r->size);
+  r->ptr = __builtin_bswap32(r->ptr);
+  r->arg = __builtin_bswap32(r->arg);
+}
+
+/* Trace file is a sequence of dumps, each made of a header and records. */
+static void load_trace(const char *path) {
+  FILE *f = fopen(path, "rb");
+  if (f == NULL) {
+    perror(path);
+    exit(EXIT_FAILURE);
+  }
+
+  MemTraceHdr_t hdr;
+  while (fread(&hdr, sizeof(hdr), 1, f) == 1) {
+    int swap = 0;
+    if (hdr.magic != MEMTRACE_MAGIC) {
+      if (__builtin_bswap32(hdr.magic) != MEMTRACE_MAGIC) {
+        fprintf(stderr, "%s: not a memory trace!\n", path);
+        exit(EXIT_FAILURE);
+      }
+      hdr.count = __builtin_bswap32(hdr.count);
+      hdr.dropped = __builtin_bswap32(hdr.dropped);
+      swap = 1;
+    }
+
+    Trace = realloc(Trace, (TraceLen + hdr.count) * sizeof(MemTraceRec_t));
+    MemTraceRec_t *rec = &Trace[TraceLen];
+    if (fread(rec, sizeof(MemTraceRec_t), hdr.count, f) != hdr.count) {
+      fprintf(stderr, "%s: truncated trace!\n", path);
+      exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; swap && i < hdr.count; i++)
+      swap_rec(&rec[i]);
+
+    TraceLen += hdr.count;
+    TraceDropped += hdr.dropped;
+  }
+
+  fclose(f);
+}
+
+/* --=[ pointer map ]=------------------------------------------------------ */
+
+/* Maps pointers recorded on the target to blocks allocated by replay. Open
+ * addressing with linear probing, key 0 marks an empty slot. */
+#define MAPSZ (1 << 16)
+
+typedef struct slot {
+  uint32_t key;
+  void *ptr;
+} slot_t;
+
+static slot_t Map[MAPSZ];
+static size_t MapUsed;
+
+static inline unsigned map_hash(uint32_t key) {
+  return ((key >> 3) * 2654435761U) & (MAPSZ - 1);
+}
+
+static void map_put(uint32_t key, void *ptr) {
+  if (++MapUsed > MAPSZ / 2) {
+    fprintf(stderr, "Too many live blocks!\n");
+    exit(EXIT_FAILURE);
+  }
+  unsigned i = map_hash(key);
+  while (Map[i].key != 0)
+    i = (i + 1) & (MAPSZ - 1);
+  Map[i].key = key;
+  Map[i].ptr = ptr;
+}
+
+/* Returns pointer stored under `key` and removes it from the map. */
+static void *map_del(uint32_t key) {
+  unsigned i = map_hash(key);
+  while (Map[i].key != key) {
+    if (Map[i].key == 0)
+      return NULL;
+    i = (i + 1) & (MAPSZ - 1);
+  }
+
+  void *ptr = Map[i].ptr;
+  MapUsed--;
+
+  /* Move back entries that would become unreachable. */
+  for (unsigned j = (i + 1) & (MAPSZ - 1); Map[j].key;
+       j = (j + 1) & (MAPSZ - 1)) {
+    unsigned h = map_hash(Map[j].key);
+    if (((j - h) & (MAPSZ - 1)) >= ((j - i) & (MAPSZ - 1))) {
+      Map[i] = Map[j];
+      i = j;
+    }
+  }
+  Map[i].key = 0;
+  return ptr;
+}
+
+/* --=[ replay ]=----------------------------------------------------------- */
+
+static int HaveChip;
+static size_t Unmatched, Failed;
+
+static MemFlags_t replay_flags(uint16_t flags) {
+  if (!HaveChip)
+    flags &= ~MF_CHIP;
+  return flags;
+}
+
+static void replay_one(MemTraceRec_t *r) {
+  void *ptr, *old = NULL;
+
+  ReplayTick = r->tick;
+
+  switch (r->op) {
+    case MTR_ALLOC:
+      /* Allocation failed on the target as well. */
+      if (r->ptr == 0)
+        return;
+      if (!(ptr = MemAllocAligned(r->size, r->arg, replay_flags(r->flags)))) {
+        Failed++;
+        return;
+      }
+      map_put(r->ptr, ptr);
+      break;
+
+    case MTR_FREE:
+      if (r->ptr == 0)
+        return;
+      if (!(ptr = map_del(r->ptr))) {
+        Unmatched++;
+        return;
+      }
+      MemFree(ptr);
+      break;
+
+    case MTR_REALLOC:
+      /* Block was left intact if reallocation failed on the target. */
+      if (r->ptr == 0 && r->size > 0)
+        return;
+      if (r->arg && !(old = map_del(r->arg))) {
+        Unmatched++;
+        return;
+      }
+      ptr = MemRealloc(old, r->size);
+      if (r->size == 0)
+        return;
+      if (ptr == NULL) {
+        Failed++;
+        if (old == NULL)
+          return;
+        ptr = old;
+      }
+      map_put(r->ptr, ptr);
+      break;
+
+    default:
+      fprintf(stderr, "Unknown trace operation %d!\n", r->op);
+      exit(EXIT_FAILURE);
+  }
+}
+
+/* Releases all blocks left by the trace, so the next round starts afresh. */
+static void replay_reset(void) {
+  for (unsigned i = 0; i < MAPSZ; i++) {
+    if (Map[i].key) {
+      MemFree(Map[i].ptr);
+      Map[i].key = 0;
+    }
+  }
+  MapUsed = 0;
+
+  /* Pretend the task has exited to get its cached blocks back. */
+  vPortCleanUpTCB(NULL);
+  vTaskSetThreadLocalStoragePointer(NULL, TLS_MEMCACHE, NULL);
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+          "Usage: %s [-c chip-KiB] [-f fast-KiB] [-n rounds] [-s interval] "
+          "trace...\n",
+          prog);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv) {
+  size_t chipsz = 512, fastsz = 1024, interval = 0;
+  int rounds = 10, opt;
+
+  while ((opt = getopt(argc, argv, "c:f:n:s:")) != -1) {
+    switch (opt) {
+      case 'c':
+        chipsz = strtoul(optarg, NULL, 0);
+        break;
+      case 'f':
+        fastsz = strtoul(optarg, NULL, 0);
+        break;
+      case 'n':
+        rounds = atoi(optarg);
+        break;
+      case 's':
+        interval = strtoul(optarg, NULL, 0);
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+
+  if (optind == argc || rounds < 1 || fastsz == 0)
+    usage(argv[0]);
+
+  for (int i = optind; i < argc; i++)
+    load_trace(argv[i]);
+
+  if (TraceLen == 0) {
+    fprintf(stderr, "No records to replay!\n");
+    exit(EXIT_FAILURE);
+  }
+
+  MemRegion_t mr[3] = {};
+  int n = 0;
+
+  if (chipsz > 0) {
+    chipsz = min((chipsz << 10) & -4096, CHIP_MAXSZ);
+    void *chip = mmap((void *)CHIP_BASE, chipsz, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    if (chip == (void *)CHIP_BASE) {
+      mr[n++] = (MemRegion_t){(uintptr_t)chip, (uintptr_t)chip + chipsz};
+      HaveChip = 1;
+    } else {
+      fprintf(stderr, "Cannot map chip memory, MF_CHIP will be ignored!\n");
+    }
+  }
+
+  fastsz <<= 10;
+  void *fast = mmap(NULL, fastsz, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (fast == MAP_FAILED) {
+    perror("mmap");
+    exit(EXIT_FAILURE);
+  }
+  mr[n++] = (MemRegion_t){(uintptr_t)fast, (uintptr_t)fast + fastsz};
+
+  vPortDefineMemoryRegions(mr);
+
+  printf("trace: %zu records, %zu dropped, %u ticks\n", TraceLen, TraceDropped,
+         Trace[TraceLen - 1].tick - Trace[0].tick);
+
+  /* First round is not timed, but it samples fragmentation of free memory. */
+  if (interval == 0)
+    interval = TraceLen / 20 + 1;
+
+  double worst = 100.0;
+  size_t worstop = 0;
+
+  printf("%8s %8s %8s %6s\n", "op", "free", "largest", "ratio");
+  for (size_t i = 0; i < TraceLen; i++) {
+    replay_one(&Trace[i]);
+    size_t free = xPortGetFreeHeapSize();
+    double ratio = free ? 100.0 * MemAvail(MF_LARGEST) / free : 100.0;
+    if (ratio < worst) {
+      worst = ratio;
+      worstop = i;
+    }
+    if ((i + 1) % interval == 0 || i + 1 == TraceLen)
+      printf("%8zu %8zu %8zu %5.1f%%\n", i + 1, free,
+             (size_t)MemAvail(MF_LARGEST), ratio);
+  }
+
+  printf("replay: %zu unmatched, %zu failed\n", Unmatched, Failed);
+  replay_reset();
+  MemCheck(0);
+
+  double start = now();
+  for (int r = 0; r < rounds; r++) {
+    for (size_t i = 0; i < TraceLen; i++)
+      replay_one(&Trace[i]);
+    replay_reset();
+  }
+  double elapsed = now() - start;
+
+  MemTraceStats_t st;
+  MemGetTraceStats(&st);
+
+  printf("speed: %.0f ops/sec (%d rounds)\n", TraceLen * rounds / elapsed,
+         rounds);
+  printf("walk: %u free blocks at most\n", st.walkmax);
+  printf("fragmentation: largest / free is %.1f%% at worst (op %zu)\n", worst,
+         worstop + 1);
+
+  return 0;
+}
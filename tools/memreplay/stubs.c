@@ -0,0 +1,61 @@
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <FreeRTOS/FreeRTOS.h>
+#include <FreeRTOS/task.h>
+#include <memory.h>
+
+/* FreeRTOS and kernel services used by kernel/memory.c. */
+
+TickType_t ReplayTick;
+
+static void *TLS[2];
+
+/* Handles of the replaying task and the idle task, which never runs. */
+static char ReplayTask, IdleTask;
+
+void HostAssert(const char *expr, const char *file, int line) {
+  fprintf(stderr, "%s:%d: assertion '%s' failed!\n", file, line, expr);
+  abort();
+}
+
+TickType_t xTaskGetTickCount(void) {
+  return ReplayTick;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+  return &ReplayTask;
+}
+
+TaskHandle_t xTaskGetIdleTaskHandle(void) {
+  return &IdleTask;
+}
+
+void *pvTaskGetThreadLocalStoragePointer(TaskHandle_t task, BaseType_t index) {
+  (void)task;
+  return TLS[index];
+}
+
+void vTaskSetThreadLocalStoragePointer(TaskHandle_t task, BaseType_t index,
+                                       void *value) {
+  (void)task;
+  TLS[index] = value;
+}
+
+void FilePrintf(File_t *f, const char *fmt, ...) {
+  va_list ap;
+  (void)f;
+  va_start(ap, fmt);
+  vprintf(fmt, ap);
+  va_end(ap);
+}
+
+int FileWrite(File_t *f, const void *buf, size_t nbyte, long *donep) {
+  (void)f;
+  fwrite(buf, 1, nbyte, stdout);
+  if (donep)
+    *donep = nbyte;
+  return 0;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+/* Just enough of FreeRTOS to build kernel/memory.c for the host. */
+
+#include <sys/types.h>
+
+#define configSUPPORT_DYNAMIC_ALLOCATION 1
+#define configUSE_MALLOC_FAILED_HOOK 0
+#define configNUM_THREAD_LOCAL_STORAGE_POINTERS 2
+
+void HostAssert(const char *expr, const char *file, int line);
+
+#define configASSERT(x)                                                        \
+  {                                                                            \
+    if (!(x))                                                                  \
+      HostAssert(#x, __FILE__, __LINE__);                                      \
+  }
+
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t TickType_t;
+typedef void *TaskHandle_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
@@ -0,0 +1,15 @@
+#pragma once
+
+static inline uint32_t Atomic_Increment_u32(uint32_t volatile *p) {
+  return (*p)++;
+}
+
+static inline uint32_t Atomic_Decrement_u32(uint32_t volatile *p) {
+  return (*p)--;
+}
+
+static inline uint32_t Atomic_Add_u32(uint32_t volatile *p, uint32_t n) {
+  uint32_t old = *p;
+  *p += n;
+  return old;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+/* Replay runs in a single thread that pretends to be a running task. */
+
+#define taskSCHEDULER_SUSPENDED 0
+#define taskSCHEDULER_NOT_STARTED 1
+#define taskSCHEDULER_RUNNING 2
+
+#define taskENTER_CRITICAL()
+#define taskEXIT_CRITICAL()
+
+static inline void vTaskSuspendAll(void) {
+}
+
+static inline BaseType_t xTaskResumeAll(void) {
+  return pdFALSE;
+}
+
+static inline BaseType_t xTaskGetSchedulerState(void) {
+  return taskSCHEDULER_RUNNING;
+}
+
+TickType_t xTaskGetTickCount(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+TaskHandle_t xTaskGetIdleTaskHandle(void);
+void *pvTaskGetThreadLocalStoragePointer(TaskHandle_t task, BaseType_t index);
+void vTaskSetThreadLocalStoragePointer(TaskHandle_t task, BaseType_t index,
+                                       void *value);
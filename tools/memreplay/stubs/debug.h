@@ -0,0 +1,8 @@
+#pragma once
+
+/* Kernel logging goes to standard output of the host process. */
+
+int printf(const char *fmt, ...);
+
+#define Log(...) printf(__VA_ARGS__)
+#define Assert(e) configASSERT(e)